@@ -36,6 +36,10 @@ class DatabaseManagerApp extends StatelessWidget {
 
 const String baseUrl = 'http://localhost:8080';
 
+/// Shared client so requests reuse the server's keep-alive connections
+/// instead of opening a new socket each time.
+final http.Client client = http.Client();
+
 /// ====================
 /// USER TAB
 /// ====================
@@ -56,7 +60,7 @@ class _UserTabState extends State<UserTab> {
     }
     final url = Uri.parse('$baseUrl/user/$username');
     try {
-      final response = await http.post(url);
+      final response = await client.post(url);
       if (response.statusCode == 200) {
         setState(() => _message = 'User created: $username');
       } else {
@@ -112,7 +116,7 @@ class _CollectionTabState extends State<CollectionTab> {
     }
     final url = Uri.parse('$baseUrl/user/$username/collection/$collectionName');
     try {
-      final response = await http.post(url);
+      final response = await client.post(url);
       if (response.statusCode == 200) {
         setState(() => _message = 'Collection created: $collectionName');
       } else {
@@ -131,7 +135,7 @@ class _CollectionTabState extends State<CollectionTab> {
     }
     final url = Uri.parse('$baseUrl/user/$username/collections');
     try {
-      final response = await http.get(url);
+      final response = await client.get(url);
       if (response.statusCode == 200) {
         List<dynamic> data = json.decode(response.body);
         setState(() {
@@ -204,9 +208,37 @@ class _DocumentTabState extends State<DocumentTab> {
   final TextEditingController _collectionController = TextEditingController();
   final TextEditingController _docJsonController = TextEditingController();
   final TextEditingController _fieldController = TextEditingController();
+  final ScrollController _scrollController = ScrollController();
   String _message = '';
   List<dynamic> _documents = [];
 
+  /// Documents are fetched a page at a time, continuing after the last
+  /// loaded _id, as the list is scrolled towards its end.
+  static const int _pageSize = 50;
+  String _listedUser = '';
+  String _listedCollection = '';
+  bool _hasMore = false;
+  bool _loadingMore = false;
+
+  /// Bumped by every new listing, so a page still in flight for an earlier
+  /// one is dropped instead of appended to the new list.
+  int _listing = 0;
+
+  @override
+  void initState() {
+    super.initState();
+    _scrollController.addListener(() {
+      final position = _scrollController.position;
+      if (position.pixels >= position.maxScrollExtent - 300) _loadMore();
+    });
+  }
+
+  @override
+  void dispose() {
+    _scrollController.dispose();
+    super.dispose();
+  }
+
   Future<void> _insertDocument() async {
     final username = _usernameController.text.trim();
     final collectionName = _collectionController.text.trim();
@@ -220,10 +252,10 @@ class _DocumentTabState extends State<DocumentTab> {
       return;
     }
     final url = Uri.parse(
-      '$baseUrl/user/$username/collection/$collectionName/document/list',
+      '$baseUrl/user/$username/collection/$collectionName/document',
     );
     try {
-      final response = await http.post(
+      final response = await client.post(
         url,
         body: docJson,
         headers: {'Content-Type': 'application/json'},
@@ -245,23 +277,53 @@ class _DocumentTabState extends State<DocumentTab> {
       setState(() => _message = 'Please enter username and collection name.');
       return;
     }
+    setState(() {
+      _listing++;
+      _listedUser = username;
+      _listedCollection = collectionName;
+      _documents = [];
+      _hasMore = true;
+      _loadingMore = false;
+    });
+    if (await _loadMore()) setState(() => _message = 'Documents loaded');
+  }
+
+  /// Fetches the next page; returns whether it arrived.
+  Future<bool> _loadMore() async {
+    if (!_hasMore || _loadingMore) return false;
+    _loadingMore = true;
+    final listing = _listing;
+    final after = _documents.isEmpty ? 0 : _documents.last['_id'];
     final url = Uri.parse(
-      '$baseUrl/user/$username/collection/$collectionName/documents',
+      '$baseUrl/user/$_listedUser/collection/$_listedCollection/documents'
+      '?after=$after&limit=$_pageSize',
     );
     try {
-      final response = await http.get(url);
+      final response = await client.get(url);
+      if (listing != _listing) return false;
       if (response.statusCode == 200) {
-        List<dynamic> data = json.decode(response.body);
+        List<dynamic> page = json.decode(response.body);
         setState(() {
-          _documents = data;
-          _message = 'Documents loaded';
+          _documents.addAll(page);
+          _hasMore = page.length == _pageSize;
         });
+        return true;
       } else {
-        setState(() => _message = 'Error: ${response.body}');
+        setState(() {
+          _hasMore = false;
+          _message = 'Error: ${response.body}';
+        });
       }
     } catch (e) {
-      setState(() => _message = 'Request failed: $e');
+      if (listing != _listing) return false;
+      setState(() {
+        _hasMore = false;
+        _message = 'Request failed: $e';
+      });
+    } finally {
+      if (listing == _listing) _loadingMore = false;
     }
+    return false;
   }
 
   Future<void> _countDocuments() async {
@@ -275,7 +337,7 @@ class _DocumentTabState extends State<DocumentTab> {
       '$baseUrl/user/$username/collection/$collectionName/count',
     );
     try {
-      final response = await http.get(url);
+      final response = await client.get(url);
       if (response.statusCode == 200) {
         var data = json.decode(response.body);
         setState(() => _message = 'Count: ${data["count"]}');
@@ -301,7 +363,7 @@ class _DocumentTabState extends State<DocumentTab> {
       '$baseUrl/user/$username/collection/$collectionName/sum?field=$field',
     );
     try {
-      final response = await http.get(url);
+      final response = await client.get(url);
       if (response.statusCode == 200) {
         var data = json.decode(response.body);
         setState(() => _message = 'Sum of "$field": ${data["sum"]}');
@@ -327,7 +389,7 @@ class _DocumentTabState extends State<DocumentTab> {
       '$baseUrl/user/$username/collection/$collectionName/distinct?field=$field',
     );
     try {
-      final response = await http.get(url);
+      final response = await client.get(url);
       if (response.statusCode == 200) {
         List<dynamic> data = json.decode(response.body);
         setState(() => _message = 'Distinct values: ${data.join(", ")}');
@@ -339,81 +401,94 @@ class _DocumentTabState extends State<DocumentTab> {
     }
   }
 
-  Widget _buildDocumentList() {
-    if (_documents.isEmpty) return Text('No documents to display.');
-    return ListView.builder(
-      shrinkWrap: true,
-      itemCount: _documents.length,
-      itemBuilder: (context, index) {
-        return ListTile(title: Text(_documents[index].toString()));
-      },
+  Widget _buildDocumentRow(int index) {
+    if (index < _documents.length) {
+      return ListTile(title: Text(_documents[index].toString()));
+    }
+    // Trailing row while more pages may follow; short pages never fill the
+    // screen, so reaching this row also asks for the next one.
+    WidgetsBinding.instance.addPostFrameCallback((_) => _loadMore());
+    return Padding(
+      padding: const EdgeInsets.all(16.0),
+      child: Center(child: CircularProgressIndicator()),
     );
   }
 
   @override
   Widget build(BuildContext context) {
-    return SingleChildScrollView(
+    // The form is the first row of the list so that documents below it
+    // are built lazily as they scroll into view.
+    return ListView.builder(
+      controller: _scrollController,
       padding: const EdgeInsets.all(16.0),
-      child: Column(
-        crossAxisAlignment: CrossAxisAlignment.start,
-        children: [
-          TextField(
-            controller: _usernameController,
-            decoration: InputDecoration(labelText: 'Username'),
-          ),
-          TextField(
-            controller: _collectionController,
-            decoration: InputDecoration(labelText: 'Collection Name'),
+      itemCount: 1 + _documents.length + (_hasMore ? 1 : 0),
+      itemBuilder: (context, index) {
+        if (index == 0) return _buildForm();
+        return _buildDocumentRow(index - 1);
+      },
+    );
+  }
+
+  Widget _buildForm() {
+    return Column(
+      crossAxisAlignment: CrossAxisAlignment.start,
+      children: [
+        TextField(
+          controller: _usernameController,
+          decoration: InputDecoration(labelText: 'Username'),
+        ),
+        TextField(
+          controller: _collectionController,
+          decoration: InputDecoration(labelText: 'Collection Name'),
+        ),
+        SizedBox(height: 16),
+        TextField(
+          controller: _docJsonController,
+          decoration: InputDecoration(
+            labelText: 'Document JSON (e.g., {"key": "value"})',
           ),
-          SizedBox(height: 16),
-          TextField(
-            controller: _docJsonController,
-            decoration: InputDecoration(
-              labelText: 'Document JSON (e.g., {"key": "value"})',
+          maxLines: 3,
+        ),
+        SizedBox(height: 16),
+        Row(
+          children: [
+            ElevatedButton(
+              onPressed: _insertDocument,
+              child: Text('Insert Document'),
             ),
-            maxLines: 3,
-          ),
-          SizedBox(height: 16),
-          Row(
-            children: [
-              ElevatedButton(
-                onPressed: _insertDocument,
-                child: Text('Insert Document'),
-              ),
-              SizedBox(width: 16),
-              ElevatedButton(
-                onPressed: _listDocuments,
-                child: Text('List Documents'),
-              ),
-            ],
-          ),
-          SizedBox(height: 16),
-          Row(
-            children: [
-              ElevatedButton(onPressed: _countDocuments, child: Text('Count')),
-              SizedBox(width: 16),
-              ElevatedButton(onPressed: _sumField, child: Text('Sum Field')),
-              SizedBox(width: 16),
-              ElevatedButton(
-                onPressed: _distinctValues,
-                child: Text('Distinct'),
-              ),
-            ],
-          ),
-          SizedBox(height: 16),
-          TextField(
-            controller: _fieldController,
-            decoration: InputDecoration(labelText: 'Field (for Sum/Distinct)'),
-          ),
-          SizedBox(height: 16),
-          Text(
-            _message,
-            style: TextStyle(fontSize: 16, fontWeight: FontWeight.bold),
-          ),
-          Divider(),
-          _buildDocumentList(),
-        ],
-      ),
+            SizedBox(width: 16),
+            ElevatedButton(
+              onPressed: _listDocuments,
+              child: Text('List Documents'),
+            ),
+          ],
+        ),
+        SizedBox(height: 16),
+        Row(
+          children: [
+            ElevatedButton(onPressed: _countDocuments, child: Text('Count')),
+            SizedBox(width: 16),
+            ElevatedButton(onPressed: _sumField, child: Text('Sum Field')),
+            SizedBox(width: 16),
+            ElevatedButton(
+              onPressed: _distinctValues,
+              child: Text('Distinct'),
+            ),
+          ],
+        ),
+        SizedBox(height: 16),
+        TextField(
+          controller: _fieldController,
+          decoration: InputDecoration(labelText: 'Field (for Sum/Distinct)'),
+        ),
+        SizedBox(height: 16),
+        Text(
+          _message,
+          style: TextStyle(fontSize: 16, fontWeight: FontWeight.bold),
+        ),
+        Divider(),
+        if (_documents.isEmpty && !_hasMore) Text('No documents to display.'),
+      ],
     );
   }
 }
@@ -0,0 +1,328 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#include "column.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+// === Aggregates ===
+// One pass over a numeric column yields count (non-null rows), sum, min and
+// max together. The kernels walk the column 64 rows at a time, one validity
+// word per block: nulls hold 0, so sums need no masking, while min/max
+// swap nulls for the identity value. AVX2 and SSE4.2 versions are picked
+// at runtime from what the CPU supports, with a scalar fallback.
+//
+// Int sums are exact: they are kept in 128 bits. The SIMD kernels sum in
+// 64-bit lanes, which wrap, so a chunk whose values are large enough that
+// a lane may have overflowed is summed again in 128 bits.
+
+struct IntAggregate {
+    uint64_t count = 0;
+    __int128 sum = 0;   // holds the sum of any 2^63 int64 values
+    int64_t min = std::numeric_limits<int64_t>::max();
+    int64_t max = std::numeric_limits<int64_t>::min();
+
+    void add(int64_t v) {
+        ++count;
+        addToSum(v);
+        min = std::min(min, v);
+        max = std::max(max, v);
+    }
+
+    void addToSum(int64_t v) { sum += v; }
+
+    // Whether sum fits an int64_t.
+    bool sumFits() const {
+        return sum >= std::numeric_limits<int64_t>::min() && sum <= std::numeric_limits<int64_t>::max();
+    }
+
+    void merge(const IntAggregate& other) {
+        count += other.count;
+        sum += other.sum;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+    }
+};
+
+// Doubles are summed with Neumaier's compensated algorithm, so adding
+// millions of values does not drift.
+struct DoubleAggregate {
+    uint64_t count = 0;
+    double sum = 0;
+    double compensation = 0;
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+
+    double total() const { return sum + compensation; }
+
+    void add(double v) {
+        ++count;
+        addToSum(v);
+        min = std::min(min, v);
+        max = std::max(max, v);
+    }
+
+    void addToSum(double v) {
+        double t = sum + v;
+        compensation += std::fabs(sum) >= std::fabs(v) ? (sum - t) + v : (v - t) + sum;
+        sum = t;
+    }
+
+    void merge(const DoubleAggregate& other) {
+        count += other.count;
+        addToSum(other.sum);
+        compensation += other.compensation;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+    }
+};
+
+// Validity bits of rows [block * 64, n); rows past n may be mid-append.
+inline uint64_t validWord(const std::atomic<uint64_t>* valid, size_t block, size_t n) {
+    uint64_t word = valid[block].load(std::memory_order_relaxed);
+    size_t rows = n - block * 64;
+    return rows >= 64 ? word : word & ((uint64_t(1) << rows) - 1);
+}
+
+// The exact sum of n values, for chunks in which a SIMD lane may have wrapped.
+inline void sumScalar(const int64_t* values, size_t n, IntAggregate& out) {
+    for (size_t i = 0; i < n; ++i) out.addToSum(values[i]);
+}
+
+// Whether lanes that each added `adds` values could have wrapped, given the
+// lanes' minima and maxima (the values left out of those are nulls, 0).
+inline bool lanesMayWrap(const int64_t* lo, const int64_t* hi, int lanes, size_t adds) {
+    __int128 bound = 0;
+    for (int i = 0; i < lanes; ++i) bound = std::max({bound, -__int128(lo[i]), __int128(hi[i])});
+    return bound * adds > std::numeric_limits<int64_t>::max();
+}
+
+// Scalar kernels, also used for the partial last block of the SIMD ones.
+inline void aggregateScalar(const int64_t* values, const std::atomic<uint64_t>* valid,
+                            size_t from, size_t n, IntAggregate& out) {
+    for (size_t block = from / 64; block * 64 < n; ++block) {
+        uint64_t word = validWord(valid, block, n);
+        out.count += __builtin_popcountll(word);
+        for (size_t i = block * 64; i < std::min(n, block * 64 + 64); ++i) {
+            out.addToSum(values[i]);
+            if (word >> (i % 64) & 1) {
+                out.min = std::min(out.min, values[i]);
+                out.max = std::max(out.max, values[i]);
+            }
+        }
+    }
+}
+
+inline void aggregateScalar(const double* values, const std::atomic<uint64_t>* valid,
+                            size_t from, size_t n, DoubleAggregate& out) {
+    for (size_t block = from / 64; block * 64 < n; ++block) {
+        uint64_t word = validWord(valid, block, n);
+        out.count += __builtin_popcountll(word);
+        for (size_t i = block * 64; i < std::min(n, block * 64 + 64); ++i) {
+            out.addToSum(values[i]);
+            if (word >> (i % 64) & 1) {
+                out.min = std::min(out.min, values[i]);
+                out.max = std::max(out.max, values[i]);
+            }
+        }
+    }
+}
+
+#ifdef HAVE_X86_SIMD
+
+__attribute__((target("avx2")))
+inline void aggregateAvx2(const int64_t* values, const std::atomic<uint64_t>* valid,
+                          size_t n, IntAggregate& out) {
+    const __m256i laneBits = _mm256_set_epi64x(8, 4, 2, 1);
+    const __m256i maxes = _mm256_set1_epi64x(std::numeric_limits<int64_t>::max());
+    const __m256i mins = _mm256_set1_epi64x(std::numeric_limits<int64_t>::min());
+    __m256i sum = _mm256_setzero_si256(), lo = maxes, hi = mins;
+    size_t blocks = n / 64;
+    for (size_t block = 0; block < blocks; ++block) {
+        uint64_t word = valid[block].load(std::memory_order_relaxed);
+        out.count += __builtin_popcountll(word);
+        for (size_t k = 0; k < 64; k += 4) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + block * 64 + k));
+            sum = _mm256_add_epi64(sum, x);
+            __m256i bits = _mm256_and_si256(_mm256_set1_epi64x(int64_t(word >> k)), laneBits);
+            __m256i present = _mm256_cmpeq_epi64(bits, laneBits);
+            __m256i forMin = _mm256_blendv_epi8(maxes, x, present);
+            __m256i forMax = _mm256_blendv_epi8(mins, x, present);
+            lo = _mm256_blendv_epi8(lo, forMin, _mm256_cmpgt_epi64(lo, forMin));
+            hi = _mm256_blendv_epi8(hi, forMax, _mm256_cmpgt_epi64(forMax, hi));
+        }
+    }
+    alignas(32) int64_t s[4], l[4], h[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(s), sum);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(l), lo);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(h), hi);
+    if (lanesMayWrap(l, h, 4, blocks * 16)) sumScalar(values, blocks * 64, out);
+    else for (int i = 0; i < 4; ++i) out.addToSum(s[i]);
+    for (int i = 0; i < 4; ++i) {
+        out.min = std::min(out.min, l[i]);
+        out.max = std::max(out.max, h[i]);
+    }
+    aggregateScalar(values, valid, blocks * 64, n, out);
+}
+
+__attribute__((target("avx2")))
+inline void aggregateAvx2(const double* values, const std::atomic<uint64_t>* valid,
+                          size_t n, DoubleAggregate& out) {
+    const __m256i laneBits = _mm256_set_epi64x(8, 4, 2, 1);
+    const __m256d signBit = _mm256_set1_pd(-0.0);
+    const __m256d inf = _mm256_set1_pd(std::numeric_limits<double>::infinity());
+    const __m256d negInf = _mm256_set1_pd(-std::numeric_limits<double>::infinity());
+    __m256d sum = _mm256_setzero_pd(), comp = _mm256_setzero_pd(), lo = inf, hi = negInf;
+    size_t blocks = n / 64;
+    for (size_t block = 0; block < blocks; ++block) {
+        uint64_t word = valid[block].load(std::memory_order_relaxed);
+        out.count += __builtin_popcountll(word);
+        for (size_t k = 0; k < 64; k += 4) {
+            __m256d x = _mm256_loadu_pd(values + block * 64 + k);
+            __m256d t = _mm256_add_pd(sum, x);
+            __m256d sumLarger = _mm256_cmp_pd(_mm256_andnot_pd(signBit, sum), _mm256_andnot_pd(signBit, x), _CMP_GE_OQ);
+            __m256d lost = _mm256_blendv_pd(_mm256_add_pd(_mm256_sub_pd(x, t), sum),
+                                            _mm256_add_pd(_mm256_sub_pd(sum, t), x), sumLarger);
+            comp = _mm256_add_pd(comp, lost);
+            sum = t;
+            __m256i bits = _mm256_and_si256(_mm256_set1_epi64x(int64_t(word >> k)), laneBits);
+            __m256d present = _mm256_castsi256_pd(_mm256_cmpeq_epi64(bits, laneBits));
+            lo = _mm256_min_pd(lo, _mm256_blendv_pd(inf, x, present));
+            hi = _mm256_max_pd(hi, _mm256_blendv_pd(negInf, x, present));
+        }
+    }
+    alignas(32) double s[4], c[4], l[4], h[4];
+    _mm256_store_pd(s, sum);
+    _mm256_store_pd(c, comp);
+    _mm256_store_pd(l, lo);
+    _mm256_store_pd(h, hi);
+    for (int i = 0; i < 4; ++i) {
+        out.addToSum(s[i]);
+        out.compensation += c[i];
+        out.min = std::min(out.min, l[i]);
+        out.max = std::max(out.max, h[i]);
+    }
+    aggregateScalar(values, valid, blocks * 64, n, out);
+}
+
+__attribute__((target("sse4.2")))
+inline void aggregateSse42(const int64_t* values, const std::atomic<uint64_t>* valid,
+                           size_t n, IntAggregate& out) {
+    const __m128i laneBits = _mm_set_epi64x(2, 1);
+    const __m128i maxes = _mm_set1_epi64x(std::numeric_limits<int64_t>::max());
+    const __m128i mins = _mm_set1_epi64x(std::numeric_limits<int64_t>::min());
+    __m128i sum = _mm_setzero_si128(), lo = maxes, hi = mins;
+    size_t blocks = n / 64;
+    for (size_t block = 0; block < blocks; ++block) {
+        uint64_t word = valid[block].load(std::memory_order_relaxed);
+        out.count += __builtin_popcountll(word);
+        for (size_t k = 0; k < 64; k += 2) {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + block * 64 + k));
+            sum = _mm_add_epi64(sum, x);
+            __m128i bits = _mm_and_si128(_mm_set1_epi64x(int64_t(word >> k)), laneBits);
+            __m128i present = _mm_cmpeq_epi64(bits, laneBits);
+            __m128i forMin = _mm_blendv_epi8(maxes, x, present);
+            __m128i forMax = _mm_blendv_epi8(mins, x, present);
+            lo = _mm_blendv_epi8(lo, forMin, _mm_cmpgt_epi64(lo, forMin));
+            hi = _mm_blendv_epi8(hi, forMax, _mm_cmpgt_epi64(forMax, hi));
+        }
+    }
+    alignas(16) int64_t s[2], l[2], h[2];
+    _mm_store_si128(reinterpret_cast<__m128i*>(s), sum);
+    _mm_store_si128(reinterpret_cast<__m128i*>(l), lo);
+    _mm_store_si128(reinterpret_cast<__m128i*>(h), hi);
+    if (lanesMayWrap(l, h, 2, blocks * 32)) sumScalar(values, blocks * 64, out);
+    else for (int i = 0; i < 2; ++i) out.addToSum(s[i]);
+    for (int i = 0; i < 2; ++i) {
+        out.min = std::min(out.min, l[i]);
+        out.max = std::max(out.max, h[i]);
+    }
+    aggregateScalar(values, valid, blocks * 64, n, out);
+}
+
+__attribute__((target("sse4.2")))
+inline void aggregateSse42(const double* values, const std::atomic<uint64_t>* valid,
+                           size_t n, DoubleAggregate& out) {
+    const __m128i laneBits = _mm_set_epi64x(2, 1);
+    const __m128d signBit = _mm_set1_pd(-0.0);
+    const __m128d inf = _mm_set1_pd(std::numeric_limits<double>::infinity());
+    const __m128d negInf = _mm_set1_pd(-std::numeric_limits<double>::infinity());
+    __m128d sum = _mm_setzero_pd(), comp = _mm_setzero_pd(), lo = inf, hi = negInf;
+    size_t blocks = n / 64;
+    for (size_t block = 0; block < blocks; ++block) {
+        uint64_t word = valid[block].load(std::memory_order_relaxed);
+        out.count += __builtin_popcountll(word);
+        for (size_t k = 0; k < 64; k += 2) {
+            __m128d x = _mm_loadu_pd(values + block * 64 + k);
+            __m128d t = _mm_add_pd(sum, x);
+            __m128d sumLarger = _mm_cmpge_pd(_mm_andnot_pd(signBit, sum), _mm_andnot_pd(signBit, x));
+            __m128d lost = _mm_blendv_pd(_mm_add_pd(_mm_sub_pd(x, t), sum),
+                                         _mm_add_pd(_mm_sub_pd(sum, t), x), sumLarger);
+            comp = _mm_add_pd(comp, lost);
+            sum = t;
+            __m128i bits = _mm_and_si128(_mm_set1_epi64x(int64_t(word >> k)), laneBits);
+            __m128d present = _mm_castsi128_pd(_mm_cmpeq_epi64(bits, laneBits));
+            lo = _mm_min_pd(lo, _mm_blendv_pd(inf, x, present));
+            hi = _mm_max_pd(hi, _mm_blendv_pd(negInf, x, present));
+        }
+    }
+    alignas(16) double s[2], c[2], l[2], h[2];
+    _mm_store_pd(s, sum);
+    _mm_store_pd(c, comp);
+    _mm_store_pd(l, lo);
+    _mm_store_pd(h, hi);
+    for (int i = 0; i < 2; ++i) {
+        out.addToSum(s[i]);
+        out.compensation += c[i];
+        out.min = std::min(out.min, l[i]);
+        out.max = std::max(out.max, h[i]);
+    }
+    aggregateScalar(values, valid, blocks * 64, n, out);
+}
+
+#endif
+
+enum class SimdLevel { Scalar, Sse42, Avx2 };
+
+inline SimdLevel simdLevel() {
+    static const SimdLevel level = [] {
+#ifdef HAVE_X86_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return SimdLevel::Avx2;
+        if (__builtin_cpu_supports("sse4.2")) return SimdLevel::Sse42;
+#endif
+        return SimdLevel::Scalar;
+    }();
+    return level;
+}
+
+template <typename T, typename Aggregate>
+Aggregate aggregateView(const typename NumericColumn<T>::View& view, SimdLevel level) {
+    Aggregate out;
+    view.forEachChunk([&](const T* values, const std::atomic<uint64_t>* valid, size_t n) {
+        switch (level) {
+#ifdef HAVE_X86_SIMD
+            case SimdLevel::Avx2: aggregateAvx2(values, valid, n, out); return;
+            case SimdLevel::Sse42: aggregateSse42(values, valid, n, out); return;
+#endif
+            default: aggregateScalar(values, valid, 0, n, out); return;
+        }
+    });
+    return out;
+}
+
+inline IntAggregate aggregate(const NumericColumn<int64_t>::View& view, SimdLevel level = simdLevel()) {
+    return aggregateView<int64_t, IntAggregate>(view, level);
+}
+
+inline DoubleAggregate aggregate(const NumericColumn<double>::View& view, SimdLevel level = simdLevel()) {
+    return aggregateView<double, DoubleAggregate>(view, level);
+}
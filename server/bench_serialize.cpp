@@ -0,0 +1,117 @@
+// Serialization microbenchmark: writes the same documents through a
+// nlohmann::json tree (the previous path) and through appendJson, checks
+// that both parse to the same JSON, and prints the time per document.
+//
+//   g++ -std=c++17 -O2 bench_serialize.cpp -o bench_serialize && ./bench_serialize [count]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+#include "document.hpp"
+#include "json_writer.hpp"
+
+using namespace std;
+using json = nlohmann::json;
+
+json toTree(const Value& value);
+
+json toTree(DocumentView doc) {
+    json j = json::object();
+    doc.forEach([&](string_view key, const Value& value) { j[string(key)] = toTree(value); });
+    return j;
+}
+
+json toTree(const Value& value) {
+    switch (value.type()) {
+        case ValueType::Null: return nullptr;
+        case ValueType::Bool: return value.asBool();
+        case ValueType::Int: return value.asInt();
+        case ValueType::Double: return value.asDouble();
+        case ValueType::String: return string(value.asString());
+        case ValueType::Object: return toTree(value.asObject());
+        case ValueType::Array: {
+            json j = json::array();
+            DocumentView items = value.asObject();
+            for (size_t i = 0; i < items.size(); ++i) j.push_back(toTree(items.value(i)));
+            return j;
+        }
+    }
+    return nullptr;
+}
+
+// A user-profile-like document: a dozen scalars, text with the odd
+// character that needs escaping, a small array and a nested object.
+Document makeDocument(mt19937_64& rng, int64_t id) {
+    auto& names = fieldNames();
+    DocumentBuilder b;
+    b.addInt(names.intern("age"), int64_t(rng() % 90));
+    b.addDouble(names.intern("score"), double(rng() % 100000) / 7);
+    b.addBool(names.intern("active"), rng() % 2);
+    b.addNull(names.intern("deleted_at"));
+    b.addString(names.intern("name"), "user" + to_string(rng() % 100000));
+    b.addString(names.intern("email"), "someone" + to_string(rng() % 1000) + "@example.com");
+    string bio = "Likes long walks, \"quoted\" words and paths like C:\\tmp.\nSecond line of a longer "
+                 "biography that mostly consists of plain text without anything to escape.";
+    b.addString(names.intern("bio"), bio);
+    b.addString(names.intern("city"), "Springfield");
+    b.addInt(names.intern("visits"), int64_t(rng() % 1000000));
+    b.addDouble(names.intern("balance"), double(rng() % 1000000) / 100);
+
+    DocumentBuilder tags;
+    for (uint32_t i = 0; i < 4; ++i) tags.addString(i, "tag" + to_string(rng() % 50));
+    b.addArray(names.intern("tags"), tags.build());
+
+    DocumentBuilder address;
+    address.addString(names.intern("street"), "742 Evergreen Terrace");
+    address.addInt(names.intern("zip"), int64_t(rng() % 100000));
+    b.addObject(names.intern("address"), address.build());
+    return b.build().withId(id);
+}
+
+template <typename Fn>
+double nanosPerDoc(size_t count, Fn&& fn) {
+    auto start = chrono::steady_clock::now();
+    fn();
+    auto elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start);
+    return double(elapsed.count()) / count;
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200000;
+    mt19937_64 rng(42);
+    vector<Document> docs;
+    docs.reserve(count);
+    for (size_t i = 0; i < count; ++i) docs.push_back(makeDocument(rng, int64_t(i + 1)));
+
+    for (size_t i = 0; i < min<size_t>(count, 1000); ++i) {
+        string direct;
+        appendJson(direct, docs[i].view());
+        if (json::parse(direct) != toTree(docs[i].view())) {
+            fprintf(stderr, "mismatch on document %zu: %s\n", i, direct.c_str());
+            return 1;
+        }
+    }
+
+    size_t bytes = 0;
+    double tree = nanosPerDoc(count, [&] {
+        for (auto& doc : docs) bytes += toTree(doc.view()).dump().size();
+    });
+    string out;
+    double direct = nanosPerDoc(count, [&] {
+        for (auto& doc : docs) {
+            out.clear();
+            appendJson(out, doc.view());
+            bytes += out.size();
+        }
+    });
+
+    printf("%zu documents, %.0f bytes each\n", count, double(bytes) / (2 * count));
+    printf("nlohmann tree + dump: %8.1f ns/doc\n", tree);
+    printf("appendJson:           %8.1f ns/doc  (%.1fx)\n", direct, tree / direct);
+    return 0;
+}
@@ -0,0 +1,239 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+#include "document.hpp"
+
+// === BTreeIndex ===
+// Ordered index: a B+-tree of (value, row) entries in compareValues order,
+// ties broken by row so every entry is unique. Nodes are wide (64 entries,
+// 2 KB leaves) with the keys stored inline, and leaves are linked both ways
+// for ordered scans. Inner nodes keep the entry count of each child, so the
+// number of entries in a range takes two root-to-leaf walks.
+//
+// Lookups take predicates rather than bounds: `below` must hold for a
+// prefix of the key order (e.g. "key < 30"), and every query is phrased as
+// the first entry for which such a predicate fails.
+class BTreeIndex {
+public:
+    BTreeIndex() : root(new Leaf()) {}
+    BTreeIndex(const BTreeIndex&) = delete;
+    BTreeIndex& operator=(const BTreeIndex&) = delete;
+
+    ~BTreeIndex() { destroy(root); }
+
+    void add(const Value& key, size_t row) {
+        std::unique_lock<std::shared_mutex> lock(mtx);
+        Split split = insert(root, Entry{key, row});
+        if (!split.node) return;
+        auto* top = new Inner();
+        top->n = 2;
+        top->children[0] = root;
+        top->children[1] = split.node;
+        top->counts[0] = count(root);
+        top->counts[1] = count(split.node);
+        top->keys[0] = split.separator;
+        root = top;
+    }
+
+    // Number of entries whose key satisfies the prefix predicate.
+    template <typename Pred>
+    size_t countPrefix(Pred below) const {
+        std::shared_lock<std::shared_mutex> lock(mtx);
+        size_t total = 0;
+        const Node* node = root;
+        while (!node->leaf) {
+            auto* inner = static_cast<const Inner*>(node);
+            int c = childFor(inner, below);
+            for (int i = 0; i < c; ++i) total += inner->counts[i];
+            node = inner->children[c];
+        }
+        auto* leaf = static_cast<const Leaf*>(node);
+        return total + firstFailing(leaf, below);
+    }
+
+    // Rows of the entries past the `below` prefix but still inside the
+    // `within` prefix, in key order (or reversed), at most limit of them.
+    template <typename Below, typename Within>
+    std::vector<size_t> scan(Below below, Within within, bool descending, size_t limit) const {
+        std::shared_lock<std::shared_mutex> lock(mtx);
+        std::vector<size_t> rows;
+        if (!descending) {
+            auto [leaf, i] = seek(below);
+            for (; leaf && rows.size() < limit; leaf = leaf->next, i = 0)
+                for (; i < leaf->n && rows.size() < limit; ++i) {
+                    if (!within(leaf->entries[i].key)) return rows;
+                    rows.push_back(leaf->entries[i].row);
+                }
+        } else {
+            auto [leaf, i] = seek(within);
+            for (; leaf && rows.size() < limit; leaf = leaf->prev, i = leaf ? leaf->n : 0)
+                while (i > 0 && rows.size() < limit) {
+                    --i;
+                    if (below(leaf->entries[i].key)) return rows;
+                    rows.push_back(leaf->entries[i].row);
+                }
+        }
+        return rows;
+    }
+
+private:
+    static const int kFanout = 64;
+
+    struct Entry {
+        Value key;
+        size_t row = 0;
+    };
+
+    // Nodes hold one slot more than kFanout so an insert can overflow a
+    // node before it is split.
+    struct Node {
+        bool leaf;
+        int n = 0;   // entries in a leaf, children in an inner node
+        explicit Node(bool leaf) : leaf(leaf) {}
+    };
+
+    struct Leaf : Node {
+        Leaf() : Node(true) {}
+        Entry entries[kFanout + 1];
+        Leaf* prev = nullptr;
+        Leaf* next = nullptr;
+    };
+
+    struct Inner : Node {
+        Inner() : Node(false) {}
+        Entry keys[kFanout];   // keys[i] is the first entry under children[i + 1]
+        Node* children[kFanout + 1];
+        size_t counts[kFanout + 1];
+    };
+
+    struct Split {
+        Node* node = nullptr;   // new right sibling, if the node split
+        Entry separator;
+    };
+
+    static bool less(const Entry& a, const Entry& b) {
+        int c = compareValues(a.key, b.key);
+        return c < 0 || (c == 0 && a.row < b.row);
+    }
+
+    static size_t count(const Node* node) {
+        if (node->leaf) return node->n;
+        auto* inner = static_cast<const Inner*>(node);
+        size_t total = 0;
+        for (int i = 0; i < inner->n; ++i) total += inner->counts[i];
+        return total;
+    }
+
+    static void destroy(Node* node) {
+        if (node->leaf) {
+            delete static_cast<Leaf*>(node);
+            return;
+        }
+        auto* inner = static_cast<Inner*>(node);
+        for (int i = 0; i < inner->n; ++i) destroy(inner->children[i]);
+        delete inner;
+    }
+
+    // The child that holds the first entry failing the predicate: the last
+    // one whose lower separator still satisfies it.
+    template <typename Pred>
+    static int childFor(const Inner* inner, Pred below) {
+        int lo = 0, hi = inner->n - 1;
+        while (lo < hi) {
+            int mid = (lo + hi + 1) / 2;
+            if (below(inner->keys[mid - 1].key)) lo = mid;
+            else hi = mid - 1;
+        }
+        return lo;
+    }
+
+    template <typename Pred>
+    static int firstFailing(const Leaf* leaf, Pred below) {
+        int lo = 0, hi = leaf->n;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (below(leaf->entries[mid].key)) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    // Leaf and position of the first entry failing the predicate; the
+    // position may be one past the leaf's last entry.
+    template <typename Pred>
+    std::pair<const Leaf*, int> seek(Pred below) const {
+        const Node* node = root;
+        while (!node->leaf) {
+            auto* inner = static_cast<const Inner*>(node);
+            node = inner->children[childFor(inner, below)];
+        }
+        auto* leaf = static_cast<const Leaf*>(node);
+        return {leaf, firstFailing(leaf, below)};
+    }
+
+    Split insert(Node* node, const Entry& e) {
+        if (node->leaf) {
+            auto* leaf = static_cast<Leaf*>(node);
+            int pos = leaf->n;
+            while (pos > 0 && less(e, leaf->entries[pos - 1])) {
+                leaf->entries[pos] = leaf->entries[pos - 1];
+                --pos;
+            }
+            leaf->entries[pos] = e;
+            if (++leaf->n <= kFanout) return {};
+            return splitLeaf(leaf);
+        }
+
+        auto* inner = static_cast<Inner*>(node);
+        int c = 0;
+        while (c + 1 < inner->n && !less(e, inner->keys[c])) ++c;
+        ++inner->counts[c];
+        Split split = insert(inner->children[c], e);
+        if (!split.node) return {};
+
+        for (int i = inner->n; i > c + 1; --i) {
+            inner->children[i] = inner->children[i - 1];
+            inner->counts[i] = inner->counts[i - 1];
+            inner->keys[i - 1] = inner->keys[i - 2];
+        }
+        inner->children[c + 1] = split.node;
+        inner->keys[c] = split.separator;
+        inner->counts[c] = count(inner->children[c]);
+        inner->counts[c + 1] = count(split.node);
+        if (++inner->n <= kFanout) return {};
+        return splitInner(inner);
+    }
+
+    static Split splitLeaf(Leaf* left) {
+        auto* right = new Leaf();
+        int half = left->n / 2;
+        for (int i = half; i < left->n; ++i) right->entries[i - half] = left->entries[i];
+        right->n = left->n - half;
+        left->n = half;
+        right->next = left->next;
+        if (right->next) right->next->prev = right;
+        right->prev = left;
+        left->next = right;
+        return {right, right->entries[0]};
+    }
+
+    static Split splitInner(Inner* left) {
+        auto* right = new Inner();
+        int half = left->n / 2;
+        for (int i = half; i < left->n; ++i) {
+            right->children[i - half] = left->children[i];
+            right->counts[i - half] = left->counts[i];
+        }
+        for (int i = half; i < left->n - 1; ++i) right->keys[i - half] = left->keys[i];
+        right->n = left->n - half;
+        left->n = half;
+        return {right, left->keys[half - 1]};
+    }
+
+    mutable std::shared_mutex mtx;
+    Node* root;
+};
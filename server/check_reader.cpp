@@ -0,0 +1,177 @@
+// Differential check of JsonReader against nlohmann::json: feeds both the
+// same generated inputs (valid documents, mutated ones and random token
+// soup, plus escape runs placed across the reader's 64-byte block edges)
+// and requires them to accept and reject the same inputs and to encode
+// accepted ones to identical document bytes.
+//
+//   g++ -std=c++17 -O2 check_reader.cpp -o check_reader && ./check_reader [count]
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <random>
+#include <string>
+
+#include "json.hpp"
+#include "document.hpp"
+#include "json_reader.hpp"
+
+using namespace std;
+using json = nlohmann::json;
+
+// The encoding the server used before JsonReader: through a nlohmann tree.
+Document encodeTree(const json& j) {
+    DocumentBuilder builder;
+    uint32_t position = 0;
+    for (auto it = j.begin(); it != j.end(); ++it) {
+        uint32_t key = j.is_array() ? position++ : fieldNames().intern(it.key());
+        const json& v = it.value();
+        switch (v.type()) {
+            case json::value_t::null: builder.addNull(key); break;
+            case json::value_t::boolean: builder.addBool(key, v.get<bool>()); break;
+            case json::value_t::number_integer: builder.addInt(key, v.get<int64_t>()); break;
+            case json::value_t::number_unsigned:
+                // Past int64 the reader falls back to a double, as nlohmann's signed parse would.
+                if (v.get<uint64_t>() > uint64_t(INT64_MAX)) builder.addDouble(key, v.get<double>());
+                else builder.addInt(key, v.get<int64_t>());
+                break;
+            case json::value_t::number_float: builder.addDouble(key, v.get<double>()); break;
+            case json::value_t::string: builder.addString(key, v.get_ref<const string&>()); break;
+            case json::value_t::object: builder.addObject(key, encodeTree(v)); break;
+            case json::value_t::array: builder.addArray(key, encodeTree(v)); break;
+            default: throw runtime_error("Unexpected JSON type");
+        }
+    }
+    return builder.build();
+}
+
+mt19937_64 rng(1);
+
+// Fragments that tend to sit on parsing edge cases.
+const string kPieces[] = {
+    "{", "}", "[", "]", ":", ",", "\"", "\\", "\\\\", "\\\"", "\\u00e9", "\\ud83d\\ude00", "\\ud83d",
+    "a", "0", "-1", "1.5e3", "1e", "01", "true", "fals", "null", " ", "\n", "\t", "\xc3\xa9", "\xff",
+    "\x01", "9223372036854775808", "-9223372036854775809", "1E+2", "1e-400", "1e400", "\"k\"",
+    "\"k\":1", ",\"x\":[1,2,{\"y\":\"\\n\"}]",
+};
+
+const string& piece() { return kPieces[rng() % size(kPieces)]; }
+
+string randomString() {
+    string s = "\"";
+    for (int i = 0, n = int(rng() % 80); i < n; ++i) {
+        switch (rng() % 12) {
+            case 0: s += "\\\""; break;
+            case 1: s += "\\\\"; break;
+            case 2: s += "\\n"; break;
+            case 3: s += "\\u00e9"; break;
+            case 4: s += "\xc3\xa9"; break;
+            case 5: s += "\\ud83d\\ude00"; break;
+            default: s += char('a' + rng() % 26);
+        }
+    }
+    return s + "\"";
+}
+
+string randomValue(int depth) {
+    switch (rng() % (depth > 4 ? 5 : 9)) {
+        case 0: return "null";
+        case 1: return rng() % 2 ? "true" : "false";
+        case 2: return to_string(int64_t(rng())) + (rng() % 3 ? "" : ".25e-3");
+        case 3: return to_string(int(rng() % 100) - 50);
+        case 4: return randomString();
+        case 5:
+        case 6: {
+            string s = "{";
+            for (int i = 0, n = int(rng() % 6); i < n; ++i) {
+                if (i) s += rng() % 2 ? "," : " , ";
+                s += "\"f" + to_string(rng() % 8) + "\" : " + randomValue(depth + 1);
+            }
+            return s + "}";
+        }
+        default: {
+            string s = "[ ";
+            for (int i = 0, n = int(rng() % 6); i < n; ++i) {
+                if (i) s += ",";
+                s += randomValue(depth + 1);
+            }
+            return s + " ]";
+        }
+    }
+}
+
+string generate(size_t i) {
+    if (i % 3 == 0) {
+        string text;
+        for (int k = 0, n = int(rng() % 12); k < n; ++k) text += piece();
+        return text;
+    }
+    string text = randomValue(0);
+    if (i % 3 == 2) {
+        size_t at = rng() % text.size();
+        switch (rng() % 3) {
+            case 0: text.erase(at, 1); break;
+            case 1: text.insert(at, piece()); break;
+            default: text[at] = piece()[0];
+        }
+    }
+    return text;
+}
+
+size_t mismatches = 0, accepted = 0;
+
+// Returns whether both parsers agree on text, an array read as one value.
+bool agree(const string& text) {
+    bool treeOk = true, readerOk = true;
+    string tree, reader;
+    try {
+        tree = string(encodeTree(json::parse(text)).bytes());
+    } catch (exception&) {
+        treeOk = false;
+    }
+    try {
+        DocumentBuilder builder;
+        JsonReader(text).readValue(builder, 0);
+        // The value is element 0 of the builder's document; text is always
+        // an array, which encodes like a document.
+        Document doc = builder.build();
+        reader = string(doc.view().value(0).bytes());
+    } catch (exception&) {
+        readerOk = false;
+    }
+    if (treeOk == readerOk && tree == reader) {
+        accepted += treeOk;
+        return true;
+    }
+    if (++mismatches <= 20) printf("mismatch (nlohmann %s, reader %s): %s\n", treeOk ? "ok" : "error",
+                                   readerOk ? "ok" : "error", text.c_str());
+    return false;
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 300000;
+    size_t agreed = 0;
+    for (size_t i = 0; i < count; ++i) agreed += agree("[" + generate(i) + "]");
+    printf("generated: %zu/%zu agree, %zu valid\n", agreed, count, accepted);
+
+    // Runs of backslashes and quotes starting at every offset around the
+    // first block edge, where escape state carries from block to block.
+    size_t edges = 0, edgesAgreed = 0;
+    for (size_t offset = 40; offset < 90; ++offset) {
+        for (size_t run = 1; run <= 6; ++run) {
+            for (const char* tail : {"\"", "\\\"", "n\"", "\"]", "x\",\"y\""}) {
+                for (const char* fill : {"\\", "\\\\", "\\\""}) {
+                    string text = "[\"" + string(offset, 'a');
+                    for (size_t k = 0; k < run; ++k) text += fill;
+                    text += tail;
+                    text += "]";
+                    ++edges;
+                    edgesAgreed += agree(text);
+                }
+            }
+        }
+    }
+    printf("block edges: %zu/%zu agree\n", edgesAgreed, edges);
+    return mismatches == 0 ? 0 : 1;
+}
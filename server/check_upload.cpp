@@ -0,0 +1,142 @@
+// Check of EventLoop's request size limit against uploads: runs a loop with
+// a small maxRequestBytes and a handler that takes POST /upload bodies as
+// an upload, then sends requests head and body in a single write. An
+// upload larger than the limit must be consumed whole, a plain request
+// body larger than it must get a 413, and both must leave the loop serving.
+//
+//   g++ -std=c++17 -O2 -pthread check_upload.cpp -o check_upload && ./check_upload [rounds]
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "event_loop.hpp"
+
+using namespace std;
+
+const size_t kLimit = 1 << 20;
+
+void reply(Connection& conn, const string& body) {
+    conn.out += "HTTP/1.1 200 OK\r\nContent-Length: " + to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+// Answers each request with the length of its body.
+void handle(Connection& conn) {
+    while (!conn.closeAfterWrite) {
+        if (conn.upload) {
+            if (conn.upload(conn)) return;
+            conn.upload = nullptr;
+            continue;
+        }
+        if (conn.http.parse(conn.in) != HttpParser::Status::Done) return;
+        const HttpRequest& request = conn.http.request();
+        size_t headBytes = request.headBytes, length = request.contentLength;
+        if (request.path == "/upload") {
+            conn.upload = [left = length, seen = size_t(0)](Connection& conn) mutable {
+                size_t take = min(left, conn.in.size());
+                conn.in.erase(0, take);
+                left -= take;
+                seen += take;
+                if (left > 0) return true;
+                reply(conn, to_string(seen));
+                return false;
+            };
+            conn.in.erase(0, headBytes);
+            conn.http.reset();
+            continue;
+        }
+        if (conn.in.size() - headBytes < length) return;
+        conn.in.erase(0, headBytes + length);
+        conn.http.reset();
+        reply(conn, to_string(length));
+    }
+}
+
+int connectTo(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        exit(1);
+    }
+    return fd;
+}
+
+// Sends head and body with one send call (on a thread of its own, since
+// the server may answer before it has read everything) and returns the
+// response, read until its body is complete or the server closes.
+string exchange(int port, const string& path, size_t bodySize) {
+    int fd = connectTo(port);
+    string request = "POST " + path + " HTTP/1.1\r\nContent-Length: " + to_string(bodySize) + "\r\n\r\n";
+    request.append(bodySize, 'x');
+    thread sender([&] {
+        size_t sent = 0;
+        while (sent < request.size()) {
+            ssize_t n = send(fd, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) break;
+            sent += n;
+        }
+    });
+    string response;
+    char buffer[4096];
+    while (true) {
+        size_t end = response.find("\r\n\r\n");
+        if (end != string::npos) {
+            size_t at = response.find("Content-Length: ");
+            if (at != string::npos && response.size() >= end + 4 + stoul(response.substr(at + 16))) break;
+        }
+        ssize_t got = recv(fd, buffer, sizeof(buffer), 0);
+        if (got <= 0) break;
+        response.append(buffer, got);
+    }
+    shutdown(fd, SHUT_RDWR);
+    sender.join();
+    close(fd);
+    return response;
+}
+
+size_t failures = 0;
+
+void expect(const string& what, const string& response, const string& status, const string& body) {
+    bool ok = response.compare(0, status.size(), status) == 0 &&
+              response.size() >= body.size() && response.compare(response.size() - body.size(), body.size(), body) == 0;
+    if (!ok && ++failures <= 10) printf("%s: got \"%.60s\"\n", what.c_str(), response.c_str());
+}
+
+int main(int argc, char** argv) {
+    size_t rounds = argc > 1 ? strtoul(argv[1], nullptr, 10) : 20;
+
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t size = sizeof(addr);
+    if (bind(server, (sockaddr*)&addr, size) < 0 || listen(server, SOMAXCONN) < 0 ||
+        getsockname(server, (sockaddr*)&addr, &size) < 0) {
+        perror("bind/listen");
+        return 1;
+    }
+    int port = ntohs(addr.sin_port);
+
+    EventLoop::Options options;
+    options.maxRequestBytes = kLimit;
+    // The loop serves until the process exits.
+    thread([&] { EventLoop(server, options, handle).run(); }).detach();
+
+    for (size_t i = 0; i < rounds; ++i) {
+        size_t upload = kLimit * 8 + i;
+        expect("upload", exchange(port, "/upload", upload), "HTTP/1.1 200", "\r\n\r\n" + to_string(upload));
+        expect("oversized", exchange(port, "/plain", kLimit * 4), "HTTP/1.1 413", "\r\n\r\n");
+        expect("plain", exchange(port, "/plain", 1000 + i), "HTTP/1.1 200", "\r\n\r\n" + to_string(1000 + i));
+    }
+    printf("%zu rounds: %zu failures\n", rounds, failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cerrno>
+#include <fcntl.h>
+#include <libgen.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "codec.hpp"
+
+// === Checkpoint file format ===
+//   header     "DBCKPT01" | u64 walSeq | u64 directoryOffset | u64 sectionCount
+//   sections   opaque byte ranges, written back to back
+//   directory  sectionCount x (u64 offset | u64 length | u32 crc)
+// The directory lets a reader hand independent sections to different
+// threads; the file is read through mmap so nothing is copied up front.
+
+static const char kCheckpointMagic[8] = {'D', 'B', 'C', 'K', 'P', 'T', '0', '1'};
+static const size_t kCheckpointHeaderSize = 32;
+
+// Streams sections to <path>.tmp and atomically renames it over <path> once
+// everything is on disk, so a crash mid-checkpoint leaves the old one intact.
+class CheckpointWriter {
+public:
+    CheckpointWriter(std::string path, uint64_t walSeq) : path(std::move(path)), walSeq(walSeq) {
+        tmpPath = this->path + ".tmp";
+        fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) throw std::runtime_error("Cannot create " + tmpPath);
+        buffer.assign(kCheckpointHeaderSize, '\0');   // patched in finish()
+    }
+
+    ~CheckpointWriter() {
+        if (fd >= 0) {
+            close(fd);
+            unlink(tmpPath.c_str());
+        }
+    }
+
+    void beginSection() {
+        sectionStart = offset + buffer.size();
+        sectionCrc = 0;
+        crcPos = buffer.size();
+    }
+
+    void write(std::string_view bytes) {
+        buffer.append(bytes.data(), bytes.size());
+        if (buffer.size() >= (1 << 20)) spill();
+    }
+
+    void endSection() {
+        sectionCrc = crc32(std::string_view(buffer).substr(crcPos), sectionCrc);
+        crcPos = buffer.size();
+        directory.push_back({sectionStart, offset + buffer.size() - sectionStart, sectionCrc});
+    }
+
+    void finish() {
+        uint64_t directoryOffset = offset + buffer.size();
+        ByteWriter w(buffer);
+        for (auto& entry : directory) {
+            w.u64(entry.offset);
+            w.u64(entry.length);
+            w.u32(entry.crc);
+        }
+        spill();
+
+        std::string header(kCheckpointMagic, sizeof(kCheckpointMagic));
+        ByteWriter h(header);
+        h.u64(walSeq);
+        h.u64(directoryOffset);
+        h.u64(directory.size());
+        if (pwrite(fd, header.data(), header.size(), 0) != ssize_t(header.size()) || fsync(fd) != 0)
+            throw std::runtime_error("Cannot write " + tmpPath);
+        close(fd);
+        fd = -1;
+
+        if (rename(tmpPath.c_str(), path.c_str()) != 0)
+            throw std::runtime_error("Cannot install " + path);
+        std::string dir = path;
+        int dirFd = open(dirname(dir.data()), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dirFd >= 0) {
+            fsync(dirFd);
+            close(dirFd);
+        }
+    }
+
+private:
+    struct Entry { uint64_t offset, length; uint32_t crc; };
+
+    void spill() {
+        sectionCrc = crc32(std::string_view(buffer).substr(crcPos), sectionCrc);
+        size_t done = 0;
+        while (done < buffer.size()) {
+            ssize_t n = ::write(fd, buffer.data() + done, buffer.size() - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) throw std::runtime_error("Cannot write " + tmpPath);
+            done += n;
+        }
+        offset += buffer.size();
+        buffer.clear();
+        crcPos = 0;
+    }
+
+    std::string path, tmpPath;
+    uint64_t walSeq;
+    int fd = -1;
+    std::string buffer;
+    uint64_t offset = 0;        // file bytes written so far
+    uint64_t sectionStart = 0;
+    uint32_t sectionCrc = 0;
+    size_t crcPos = 0;          // buffer bytes already folded into sectionCrc
+    std::vector<Entry> directory;
+};
+
+// Maps a checkpoint read-only. A missing file reads as an empty checkpoint.
+class CheckpointReader {
+public:
+    explicit CheckpointReader(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return;
+        struct stat st{};
+        fstat(fd, &st);
+        size = st.st_size;
+        if (size > 0) {
+            void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) data = static_cast<const char*>(mapped);
+        }
+        close(fd);
+        if (!data || size < kCheckpointHeaderSize ||
+            std::string_view(data, 8) != std::string_view(kCheckpointMagic, 8))
+            throw std::runtime_error("Invalid checkpoint " + path);
+
+        ByteReader h(std::string_view(data + 8, kCheckpointHeaderSize - 8));
+        seq = h.u64();
+        uint64_t directoryOffset = h.u64(), count = h.u64();
+        if (directoryOffset > size || (size - directoryOffset) / 20 < count)
+            throw std::runtime_error("Invalid checkpoint " + path);
+
+        ByteReader d(std::string_view(data + directoryOffset, size - directoryOffset));
+        for (uint64_t i = 0; i < count; ++i) {
+            uint64_t offset = d.u64(), length = d.u64();
+            uint32_t crc = d.u32();
+            if (offset > size || size - offset < length)
+                throw std::runtime_error("Invalid checkpoint " + path);
+            sectionList.push_back({offset, length, crc});
+        }
+        madvise(const_cast<char*>(data), size, MADV_WILLNEED);
+    }
+
+    ~CheckpointReader() {
+        if (data) munmap(const_cast<char*>(data), size);
+    }
+
+    CheckpointReader(const CheckpointReader&) = delete;
+    CheckpointReader& operator=(const CheckpointReader&) = delete;
+
+    uint64_t walSeq() const { return seq; }
+    size_t sections() const { return sectionList.size(); }
+
+    // Verifies the section checksum before handing it out.
+    std::string_view section(size_t i) const {
+        auto& s = sectionList[i];
+        std::string_view bytes(data + s.offset, s.length);
+        if (crc32(bytes) != s.crc) throw std::runtime_error("Corrupt checkpoint section");
+        return bytes;
+    }
+
+private:
+    struct Entry { uint64_t offset, length; uint32_t crc; };
+
+    const char* data = nullptr;
+    size_t size = 0;
+    uint64_t seq = 0;
+    std::vector<Entry> sectionList;
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+// === ChunkedVector ===
+// Append-only vector with multi-version reads. Elements live in fixed-size
+// chunks that never move, so a reader can pin a version with two atomic
+// loads (element count, then chunk table) and iterate it while a writer
+// keeps appending. Readers never lock and never wait for the writer.
+//
+// Appends must be serialized by the caller (one writer at a time).
+//
+// Nothing is reclaimed while the vector is alive: elements are never
+// removed, and when the chunk table outgrows its capacity the old table is
+// retired instead of freed since readers may still be walking it. Tables
+// double in size, so the retired ones together are never larger than the
+// live table.
+template <typename T, size_t ChunkSize = 1024>
+class ChunkedVector {
+public:
+    // A pinned, immutable version: the first size() elements as of the
+    // moment snapshot() was called.
+    class Snapshot {
+    public:
+        Snapshot() = default;
+
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+
+        const T& operator[](size_t i) const { return table[i / ChunkSize][i % ChunkSize]; }
+
+        template <typename Fn>
+        void forEach(Fn&& fn) const {
+            for (size_t c = 0, i = 0; i < count; ++c) {
+                const T* chunk = table[c];
+                size_t end = std::min(ChunkSize, count - i);
+                for (size_t k = 0; k < end; ++k) fn(chunk[k]);
+                i += end;
+            }
+        }
+
+    private:
+        friend class ChunkedVector;
+        Snapshot(T* const* table, size_t count) : table(table), count(count) {}
+
+        T* const* table = nullptr;
+        size_t count = 0;
+    };
+
+    ChunkedVector() = default;
+    ChunkedVector(const ChunkedVector&) = delete;
+    ChunkedVector& operator=(const ChunkedVector&) = delete;
+
+    ~ChunkedVector() {
+        size_t n = count.load(std::memory_order_relaxed);
+        T** chunks = table.load(std::memory_order_relaxed);
+        for (size_t c = 0; c * ChunkSize < n; ++c) {
+            size_t end = std::min(ChunkSize, n - c * ChunkSize);
+            for (size_t k = 0; k < end; ++k) chunks[c][k].~T();
+            ::operator delete(chunks[c]);
+        }
+        delete[] chunks;
+        for (T** old : retired) delete[] old;
+    }
+
+    size_t size() const { return count.load(std::memory_order_acquire); }
+
+    Snapshot snapshot() const {
+        // Count first: any table published before that count covers it.
+        size_t n = count.load(std::memory_order_acquire);
+        return Snapshot(table.load(std::memory_order_acquire), n);
+    }
+
+    void push_back(T value) {
+        size_t n = count.load(std::memory_order_relaxed);
+        size_t c = n / ChunkSize;
+        T** chunks = table.load(std::memory_order_relaxed);
+
+        if (n % ChunkSize == 0) {
+            if (c == capacity) {
+                size_t grown = capacity ? capacity * 2 : 8;
+                T** next = new T*[grown]();
+                for (size_t i = 0; i < capacity; ++i) next[i] = chunks[i];
+                table.store(next, std::memory_order_release);
+                if (chunks) retired.push_back(chunks);
+                chunks = next;
+                capacity = grown;
+            }
+            chunks[c] = static_cast<T*>(::operator new(sizeof(T) * ChunkSize));
+        }
+
+        new (&chunks[c][n % ChunkSize]) T(std::move(value));
+        count.store(n + 1, std::memory_order_release);
+    }
+
+private:
+    std::atomic<T**> table{nullptr};
+    std::atomic<size_t> count{0};
+    size_t capacity = 0;              // writer only
+    std::vector<T**> retired;         // writer only
+};
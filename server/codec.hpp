@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+// Little-endian binary encoding shared by the WAL and other on-disk formats.
+
+class ByteWriter {
+public:
+    explicit ByteWriter(std::string& out) : out(out) {}
+
+    void u8(uint8_t v) { out.push_back(static_cast<char>(v)); }
+
+    void u32(uint32_t v) {
+        char b[4];
+        for (int i = 0; i < 4; ++i) b[i] = static_cast<char>(v >> (8 * i));
+        out.append(b, 4);
+    }
+
+    void u64(uint64_t v) {
+        char b[8];
+        for (int i = 0; i < 8; ++i) b[i] = static_cast<char>(v >> (8 * i));
+        out.append(b, 8);
+    }
+
+    void str(std::string_view s) {
+        u32(static_cast<uint32_t>(s.size()));
+        out.append(s.data(), s.size());
+    }
+
+private:
+    std::string& out;
+};
+
+class ByteReader {
+public:
+    explicit ByteReader(std::string_view in) : in(in) {}
+
+    bool done() const { return pos == in.size(); }
+    size_t offset() const { return pos; }
+
+    uint8_t u8() {
+        need(1);
+        return static_cast<uint8_t>(in[pos++]);
+    }
+
+    uint32_t u32() {
+        need(4);
+        uint32_t v = 0;
+        for (int i = 0; i < 4; ++i) v |= uint32_t(uint8_t(in[pos + i])) << (8 * i);
+        pos += 4;
+        return v;
+    }
+
+    uint64_t u64() {
+        need(8);
+        uint64_t v = 0;
+        for (int i = 0; i < 8; ++i) v |= uint64_t(uint8_t(in[pos + i])) << (8 * i);
+        pos += 8;
+        return v;
+    }
+
+    std::string_view str() {
+        uint32_t n = u32();
+        need(n);
+        std::string_view s = in.substr(pos, n);
+        pos += n;
+        return s;
+    }
+
+private:
+    void need(size_t n) const {
+        if (in.size() - pos < n) throw std::runtime_error("Truncated record");
+    }
+
+    std::string_view in;
+    size_t pos = 0;
+};
+
+// CRC-32 (IEEE, reflected), table driven.
+inline uint32_t crc32(std::string_view data, uint32_t crc = 0) {
+    static const auto table = [] {
+        struct { uint32_t v[256]; } t{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t.v[i] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (unsigned char ch : data) crc = table.v[(crc ^ ch) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "chunked_vector.hpp"
+#include "document.hpp"
+
+// === Columns ===
+// Optional columnar copy of a numeric field, kept next to the documents so
+// aggregates can scan one contiguous array instead of walking every
+// document. Row i of a column is document i of the collection. Values that
+// are missing or not numbers are null: their validity bit is clear and the
+// stored value is 0, so plain sums can ignore the bitmap.
+
+enum class ColumnType : uint8_t { Int, Double };
+
+template <typename T>
+class NumericColumn {
+public:
+    static constexpr size_t kChunkRows = 4096;
+
+    struct Chunk {
+        alignas(64) T values[kChunkRows];
+        std::atomic<uint64_t> valid[kChunkRows / 64];
+
+        Chunk() {
+            for (auto& word : valid) word.store(0, std::memory_order_relaxed);
+        }
+    };
+
+    // Pinned prefix of the column, safe to scan while rows are appended.
+    class View {
+    public:
+        size_t size() const { return rows; }
+
+        // Calls fn(values, validityWords, rowCount) once per chunk.
+        template <typename Fn>
+        void forEachChunk(Fn&& fn) const {
+            for (size_t c = 0, done = 0; done < rows; ++c) {
+                size_t n = std::min(kChunkRows, rows - done);
+                fn(chunks[c]->values, chunks[c]->valid, n);
+                done += n;
+            }
+        }
+
+    private:
+        friend class NumericColumn;
+        typename ChunkedVector<Chunk*, 64>::Snapshot chunks;
+        size_t rows = 0;
+    };
+
+    NumericColumn() = default;
+    NumericColumn(const NumericColumn&) = delete;
+    NumericColumn& operator=(const NumericColumn&) = delete;
+
+    ~NumericColumn() {
+        chunks.snapshot().forEach([](Chunk* chunk) { delete chunk; });
+    }
+
+    size_t size() const { return rows.load(std::memory_order_acquire); }
+
+    View view() const {
+        View v;
+        v.rows = rows.load(std::memory_order_acquire);
+        v.chunks = chunks.snapshot();
+        return v;
+    }
+
+    // Writer only.
+    void append(bool present, T value) {
+        size_t n = rows.load(std::memory_order_relaxed);
+        if (n % kChunkRows == 0) chunks.push_back(new Chunk());
+        Chunk* chunk = chunks.snapshot()[n / kChunkRows];
+        size_t i = n % kChunkRows;
+        chunk->values[i] = present ? value : T(0);
+        if (present) chunk->valid[i / 64].fetch_or(uint64_t(1) << (i % 64), std::memory_order_relaxed);
+        rows.store(n + 1, std::memory_order_release);
+    }
+
+private:
+    ChunkedVector<Chunk*, 64> chunks;
+    std::atomic<size_t> rows{0};
+};
+
+struct Column {
+    explicit Column(ColumnType type) : type(type) {}
+
+    // Appends the numeric value (if any) of the next row. An Int column
+    // cannot hold a double; ColumnSet promotes it first.
+    void append(const std::optional<Value>& v) {
+        bool numeric = v && v->isNumber();
+        if (type == ColumnType::Int) ints.append(numeric, numeric ? v->asInt() : 0);
+        else doubles.append(numeric, numeric ? v->asDouble() : 0);
+    }
+
+    const ColumnType type;
+    NumericColumn<int64_t> ints;     // rows when type == Int
+    NumericColumn<double> doubles;   // rows when type == Double
+};
+
+// The columns of one collection, keyed by field id. Lookups are lock-free:
+// the map is republished copy-on-write whenever a column is added or
+// promoted, and replaced maps and columns are retired, not freed, since
+// scans may still be using them. All mutating calls must be serialized by
+// the collection's write lock.
+class ColumnSet {
+public:
+    using Map = std::unordered_map<uint32_t, Column*>;
+
+    ColumnSet() : columns(new Map()) {}
+    ColumnSet(const ColumnSet&) = delete;
+    ColumnSet& operator=(const ColumnSet&) = delete;
+
+    ~ColumnSet() {
+        const Map* current = columns.load();
+        for (auto& [_, column] : *current) delete column;
+        delete current;
+        for (auto* map : retiredMaps) delete map;
+        for (auto* column : retiredColumns) delete column;
+    }
+
+    const Column* find(uint32_t field) const {
+        const Map* current = columns.load(std::memory_order_acquire);
+        auto it = current->find(field);
+        return it == current->end() ? nullptr : it->second;
+    }
+
+    std::vector<uint32_t> fields() const {
+        std::vector<uint32_t> ids;
+        for (auto& [field, _] : *columns.load(std::memory_order_acquire)) ids.push_back(field);
+        return ids;
+    }
+
+    // Builds a column from the existing documents. Returns false if the
+    // field already has one.
+    bool add(uint32_t field, const ChunkedVector<DocumentView>::Snapshot& docs) {
+        if (find(field)) return false;
+        bool anyDouble = false;
+        docs.forEach([&](DocumentView doc) {
+            auto v = doc.get(field);
+            anyDouble |= v && v->type() == ValueType::Double;
+        });
+        auto* column = new Column(anyDouble ? ColumnType::Double : ColumnType::Int);
+        docs.forEach([&](DocumentView doc) { column->append(doc.get(field)); });
+        publish(field, column);
+        return true;
+    }
+
+    // Appends the row for a newly inserted document to every column.
+    void append(DocumentView doc) {
+        for (auto& [field, column] : *columns.load(std::memory_order_relaxed)) {
+            auto v = doc.get(field);
+            Column* target = column;
+            if (target->type == ColumnType::Int && v && v->type() == ValueType::Double)
+                target = promote(field, target);
+            target->append(v);
+        }
+    }
+
+private:
+    Column* promote(uint32_t field, Column* old) {
+        auto* column = new Column(ColumnType::Double);
+        old->ints.view().forEachChunk([&](const int64_t* values, const std::atomic<uint64_t>* valid, size_t n) {
+            for (size_t i = 0; i < n; ++i) {
+                bool present = valid[i / 64].load(std::memory_order_relaxed) >> (i % 64) & 1;
+                column->doubles.append(present, double(values[i]));
+            }
+        });
+        publish(field, column);
+        retiredColumns.push_back(old);
+        return column;
+    }
+
+    void publish(uint32_t field, Column* column) {
+        const Map* current = columns.load(std::memory_order_relaxed);
+        auto* next = new Map(*current);
+        (*next)[field] = column;
+        columns.store(next, std::memory_order_release);
+        retiredMaps.push_back(current);
+    }
+
+    std::atomic<const Map*> columns;
+    std::vector<const Map*> retiredMaps;
+    std::vector<Column*> retiredColumns;
+};
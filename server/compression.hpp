@@ -0,0 +1,174 @@
+#pragma once
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+// gzip needs zlib and zstd needs libzstd. Neither is required: build with
+// -DWITH_ZLIB -lz and/or -DWITH_ZSTD -lzstd to enable them.
+#ifdef WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef WITH_ZSTD
+#include <zstd.h>
+#endif
+
+// === Stream compression ===
+// Incremental compressors and decompressors for export and import bodies:
+// each call takes the next piece of input and appends whatever output is
+// ready, so memory use does not depend on the stream's length.
+enum class Compression { None, Gzip, Zstd };
+
+// Parses a compress= value; throws for unknown or unavailable formats.
+inline Compression compressionNamed(std::string_view name) {
+    if (name.empty() || name == "none") return Compression::None;
+#ifdef WITH_ZLIB
+    if (name == "gzip") return Compression::Gzip;
+#endif
+#ifdef WITH_ZSTD
+    if (name == "zstd") return Compression::Zstd;
+#endif
+    if (name == "gzip" || name == "zstd") throw std::runtime_error("Server built without " + std::string(name));
+    throw std::runtime_error("Unknown compression");
+}
+
+class StreamCodec {
+public:
+    virtual ~StreamCodec() = default;
+    // Consumes all of in, appending output to out. Throws on corrupt input.
+    virtual void write(std::string_view in, std::string& out) = 0;
+    // Flushes the end of the stream; decompressors throw if it was cut short.
+    virtual void finish(std::string& out) = 0;
+};
+
+namespace compression_detail {
+
+const size_t kOutputStep = 64 * 1024;
+
+#ifdef WITH_ZLIB
+class Gzip : public StreamCodec {
+public:
+    explicit Gzip(bool compress) : compress(compress) {
+        // Window bits: 16 + 15 writes a gzip header, 32 + 15 reads gzip or zlib.
+        int rc = compress ? deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + 15, 8, Z_DEFAULT_STRATEGY)
+                          : inflateInit2(&zs, 32 + 15);
+        if (rc != Z_OK) throw std::runtime_error("zlib init failed");
+    }
+
+    ~Gzip() override {
+        if (compress) deflateEnd(&zs);
+        else inflateEnd(&zs);
+    }
+
+    void write(std::string_view in, std::string& out) override {
+        zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+        zs.avail_in = uInt(in.size());
+        // Also loops while the output step filled up: zlib may hold more.
+        do {
+            // Concatenated gzip members (cat a.gz b.gz) are one stream.
+            if (ended && zs.avail_in > 0) {
+                inflateReset(&zs);
+                ended = false;
+            }
+            if (step(out, Z_NO_FLUSH) == Z_STREAM_END) ended = true;
+        } while (zs.avail_in > 0 || zs.avail_out == 0);
+    }
+
+    void finish(std::string& out) override {
+        if (!compress) {
+            if (!ended) throw std::runtime_error("Truncated gzip stream");
+            return;
+        }
+        zs.avail_in = 0;
+        while (step(out, Z_FINISH) != Z_STREAM_END) {}
+    }
+
+private:
+    int step(std::string& out, int flush) {
+        size_t used = out.size();
+        out.resize(used + kOutputStep);
+        zs.next_out = reinterpret_cast<Bytef*>(&out[used]);
+        zs.avail_out = uInt(kOutputStep);
+        int rc = compress ? deflate(&zs, flush) : inflate(&zs, Z_NO_FLUSH);
+        out.resize(out.size() - zs.avail_out);
+        if (rc != Z_OK && rc != Z_STREAM_END && rc != Z_BUF_ERROR) throw std::runtime_error("Corrupt gzip stream");
+        return rc;
+    }
+
+    z_stream zs{};
+    bool compress;
+    bool ended = false;
+};
+#endif
+
+#ifdef WITH_ZSTD
+class Zstd : public StreamCodec {
+public:
+    explicit Zstd(bool compress) : compress(compress) {
+        if (compress) cctx = ZSTD_createCCtx();
+        else dctx = ZSTD_createDCtx();
+        if (!cctx && !dctx) throw std::runtime_error("zstd init failed");
+    }
+
+    ~Zstd() override {
+        ZSTD_freeCCtx(cctx);
+        ZSTD_freeDCtx(dctx);
+    }
+
+    void write(std::string_view in, std::string& out) override {
+        ZSTD_inBuffer input{in.data(), in.size(), 0};
+        // Also loops while the output step filled up: zstd may hold more.
+        do {
+            step(out, input, ZSTD_e_continue);
+        } while (input.pos < input.size || full);
+    }
+
+    void finish(std::string& out) override {
+        if (!compress) {
+            if (pending != 0) throw std::runtime_error("Truncated zstd stream");
+            return;
+        }
+        ZSTD_inBuffer input{nullptr, 0, 0};
+        while (step(out, input, ZSTD_e_end) != 0) {}
+    }
+
+private:
+    // Returns what zstd has left to do: bytes still to flush when
+    // compressing, a nonzero hint while a frame is unfinished when not.
+    size_t step(std::string& out, ZSTD_inBuffer& input, ZSTD_EndDirective mode) {
+        size_t used = out.size();
+        out.resize(used + kOutputStep);
+        ZSTD_outBuffer output{&out[used], kOutputStep, 0};
+        size_t rc = compress ? ZSTD_compressStream2(cctx, &output, &input, mode)
+                             : ZSTD_decompressStream(dctx, &output, &input);
+        out.resize(used + output.pos);
+        full = output.pos == output.size;
+        if (ZSTD_isError(rc)) throw std::runtime_error(std::string("Corrupt zstd stream: ") + ZSTD_getErrorName(rc));
+        if (!compress) pending = rc;
+        return rc;
+    }
+
+    bool compress;
+    ZSTD_CCtx* cctx = nullptr;
+    ZSTD_DCtx* dctx = nullptr;
+    size_t pending = 0;
+    bool full = false;
+};
+#endif
+
+}  // namespace compression_detail
+
+// Null for Compression::None.
+inline std::unique_ptr<StreamCodec> makeCodec(Compression compression, [[maybe_unused]] bool compress) {
+    switch (compression) {
+        case Compression::None: return nullptr;
+#ifdef WITH_ZLIB
+        case Compression::Gzip: return std::make_unique<compression_detail::Gzip>(compress);
+#endif
+#ifdef WITH_ZSTD
+        case Compression::Zstd: return std::make_unique<compression_detail::Zstd>(compress);
+#endif
+        default: throw std::runtime_error("Compression not available");
+    }
+}
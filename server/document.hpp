@@ -0,0 +1,509 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "chunked_vector.hpp"
+
+// === Arena ===
+// Bump allocator for document blobs and field names. Memory is only released with the
+// arena, which suits append-only collections read through snapshots.
+class Arena {
+public:
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    char* allocate(size_t n) {
+        n = (n + 7) & ~size_t(7);
+        if (n > left) {
+            size_t size = std::max(n, kBlockSize);
+            blocks.emplace_back(new char[size]);
+            cursor = blocks.back().get();
+            left = size;
+        }
+        char* p = cursor;
+        cursor += n;
+        left -= n;
+        return p;
+    }
+
+private:
+    static constexpr size_t kBlockSize = 256 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char* cursor = nullptr;
+    size_t left = 0;
+};
+
+// === FieldDictionary ===
+// Process-wide interning table for field names, so documents store a u32
+// id per key instead of the key string. Names are never removed.
+//
+// id -> name is a lock-free read from an append-only ChunkedVector. The
+// name -> id map is split into shards with their own reader-writer locks,
+// so lookups from concurrent parsers rarely touch the same lock. Assigning
+// a new id is serialized, which keeps ids dense and in the same order as
+// the onIntern callbacks (used to log new names to the WAL).
+class FieldDictionary {
+public:
+    static constexpr uint32_t kIdField = 0;   // "_id", interned up front
+
+    FieldDictionary() { intern("_id"); }
+
+    uint32_t intern(std::string_view name) {
+        if (auto id = find(name)) return *id;
+        std::lock_guard<std::mutex> lock(writeMutex);
+        if (auto id = find(name)) return *id;
+        uint32_t id = static_cast<uint32_t>(names.size());
+        // Logged before it is published: find() takes no write lock, so a
+        // visible id could otherwise reach the WAL in a document first.
+        if (onIntern) onIntern(id, name);
+        add(id, name);
+        return id;
+    }
+
+    std::optional<uint32_t> find(std::string_view name) const {
+        auto& shard = shards[std::hash<std::string_view>()(name) % kShards];
+        std::shared_lock<std::shared_mutex> lock(shard.mtx);
+        auto it = shard.ids.find(name);
+        if (it == shard.ids.end()) return std::nullopt;
+        return it->second;
+    }
+
+    std::string_view name(uint32_t id) const { return names.snapshot()[id]; }
+    size_t size() const { return names.size(); }
+
+    // Re-creates an id read back from disk. Ids must arrive in order, but
+    // names that are already known (with the same id) are accepted again.
+    void restore(uint32_t id, std::string_view name) {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        if (id < names.size()) {
+            if (names.snapshot()[id] != name) throw std::runtime_error("Conflicting field id");
+            return;
+        }
+        if (id != names.size()) throw std::runtime_error("Missing field id");
+        add(id, name);
+    }
+
+    // Called under the dictionary's write lock for every newly assigned id,
+    // before any other thread can see it.
+    std::function<void(uint32_t, std::string_view)> onIntern;
+
+private:
+    static const size_t kShards = 16;
+
+    struct Shard {
+        mutable std::shared_mutex mtx;
+        std::unordered_map<std::string_view, uint32_t> ids;
+    };
+
+    void add(uint32_t id, std::string_view name) {
+        char* stored = storage.allocate(name.size());
+        std::memcpy(stored, name.data(), name.size());
+        std::string_view view(stored, name.size());
+        names.push_back(view);
+        auto& shard = shards[std::hash<std::string_view>()(view) % kShards];
+        std::unique_lock<std::shared_mutex> lock(shard.mtx);
+        shard.ids.emplace(view, id);
+    }
+
+    std::mutex writeMutex;
+    Arena storage;
+    ChunkedVector<std::string_view> names;
+    Shard shards[kShards];
+};
+
+inline FieldDictionary& fieldNames() {
+    static FieldDictionary dictionary;
+    return dictionary;
+}
+
+// === Document encoding ===
+// A document is one contiguous, immutable byte blob:
+//
+//   u32 fieldCount | u32 totalBytes | Slot[fieldCount] | payload bytes
+//
+// Keys are FieldDictionary ids. Slots are sorted by id so lookups are a
+// binary search over a flat array of integers, and the blob can be copied,
+// logged or checkpointed as-is.
+//
+// Every value keeps its JSON type. Scalars (null, bool, int64, double) sit
+// inline in the slot; strings and nested values point into the payload
+// area. A nested object is itself an encoded document, and an array is
+// encoded the same way with element positions as keys.
+
+enum class ValueType : uint8_t { Null, Bool, Int, Double, String, Object, Array };
+
+namespace doc_detail {
+
+struct Slot {
+    uint32_t key;
+    uint8_t type;
+    uint8_t reserved[3];
+    uint64_t payload;   // bool/int64/double bits, or offset << 32 | length
+};
+static_assert(sizeof(Slot) == 16, "slots are packed into 16 bytes");
+
+const size_t kHeaderSize = 8;
+const int kMaxDepth = 256;
+
+inline uint32_t load32(const char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+inline void store32(char* p, uint32_t v) { std::memcpy(p, &v, 4); }
+
+inline bool isInline(ValueType t) { return t <= ValueType::Double; }
+
+}  // namespace doc_detail
+
+class DocumentView;
+
+// One typed field value, pointing into its document.
+class Value {
+public:
+    Value() = default;
+    Value(ValueType type, uint64_t payload, const char* base) : t(type), payload(payload), base(base) {}
+
+    ValueType type() const { return t; }
+    bool isNull() const { return t == ValueType::Null; }
+    bool isNumber() const { return t == ValueType::Int || t == ValueType::Double; }
+
+    bool asBool() const { return payload != 0; }
+    int64_t asInt() const { return t == ValueType::Double ? int64_t(asDouble()) : int64_t(payload); }
+
+    double asDouble() const {
+        if (t == ValueType::Int) return double(int64_t(payload));
+        double d;
+        std::memcpy(&d, &payload, sizeof(d));
+        return d;
+    }
+
+    // Raw payload bytes of a string, object or array.
+    std::string_view bytes() const { return {base + (payload >> 32), size_t(uint32_t(payload))}; }
+    std::string_view asString() const { return bytes(); }
+    inline DocumentView asObject() const;   // also used for arrays
+
+private:
+    friend class DocumentBuilder;
+
+    ValueType t = ValueType::Null;
+    uint64_t payload = 0;
+    const char* base = nullptr;
+};
+
+// Non-owning view of an encoded document; cheap to copy.
+class DocumentView {
+public:
+    DocumentView() = default;
+    explicit DocumentView(const char* data) : data(data) {}
+
+    size_t size() const { return data ? doc_detail::load32(data) : 0; }
+    size_t byteSize() const { return data ? doc_detail::load32(data + 4) : 0; }
+    std::string_view bytes() const { return {data, byteSize()}; }
+
+    // For arrays the key id is the element position, not a dictionary id.
+    uint32_t keyId(size_t i) const { return slot(i).key; }
+    std::string_view key(size_t i) const { return fieldNames().name(keyId(i)); }
+
+    Value value(size_t i) const {
+        auto s = slot(i);
+        return Value(ValueType(s.type), s.payload, data);
+    }
+
+    std::optional<Value> get(uint32_t id) const {
+        size_t lo = 0, hi = size();
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            uint32_t k = keyId(mid);
+            if (k == id) return value(mid);
+            if (k < id) lo = mid + 1;
+            else hi = mid;
+        }
+        return std::nullopt;
+    }
+
+    std::optional<Value> get(std::string_view name) const {
+        auto id = fieldNames().find(name);
+        return id ? get(*id) : std::nullopt;
+    }
+
+    // Calls fn(key, value) for each field of an object in key id order.
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        for (size_t i = 0, n = size(); i < n; ++i) fn(key(i), value(i));
+    }
+
+    // Checks that untrusted bytes (from disk) form a well-formed document.
+    static bool valid(std::string_view bytes, bool isArray = false, int depth = 0) {
+        using namespace doc_detail;
+        if (depth > kMaxDepth) return false;
+        if (bytes.size() < kHeaderSize || load32(bytes.data() + 4) != bytes.size()) return false;
+        uint64_t count = load32(bytes.data());
+        if ((bytes.size() - kHeaderSize) / sizeof(Slot) < count) return false;
+        size_t known = fieldNames().size();
+        for (uint64_t i = 0; i < count; ++i) {
+            Slot s;
+            std::memcpy(&s, bytes.data() + kHeaderSize + i * sizeof(Slot), sizeof(Slot));
+            if (s.type > uint8_t(ValueType::Array)) return false;
+            if (isArray ? s.key != i : s.key >= known) return false;
+            auto type = ValueType(s.type);
+            if (isInline(type)) continue;
+            uint64_t offset = s.payload >> 32, length = uint32_t(s.payload);
+            if (offset + length > bytes.size()) return false;
+            if (type != ValueType::String &&
+                !valid(bytes.substr(offset, length), type == ValueType::Array, depth + 1))
+                return false;
+        }
+        return true;
+    }
+
+private:
+    doc_detail::Slot slot(size_t i) const {
+        doc_detail::Slot s;
+        std::memcpy(&s, data + doc_detail::kHeaderSize + i * sizeof(s), sizeof(s));
+        return s;
+    }
+
+    const char* data = nullptr;
+};
+
+inline DocumentView Value::asObject() const { return DocumentView(base + (payload >> 32)); }
+
+// Copies an encoded document into an arena.
+inline DocumentView storeDocument(Arena& arena, std::string_view bytes) {
+    char* p = arena.allocate(bytes.size());
+    std::memcpy(p, bytes.data(), bytes.size());
+    return DocumentView(p);
+}
+
+// Owning document, used between parsing and storage. Default constructed
+// it is the empty document.
+class Document {
+public:
+    Document() : blob(doc_detail::kHeaderSize, '\0') { doc_detail::store32(blob.data() + 4, blob.size()); }
+
+    static Document fromBytes(std::string_view bytes) {
+        if (!DocumentView::valid(bytes)) throw std::runtime_error("Malformed document");
+        Document doc;
+        doc.blob.assign(bytes.data(), bytes.size());
+        return doc;
+    }
+
+    DocumentView view() const { return DocumentView(blob.data()); }
+    std::string_view bytes() const { return blob; }
+    size_t size() const { return view().size(); }
+    std::optional<Value> get(std::string_view key) const { return view().get(key); }
+
+    // Copy with an integer _id as its first field (id 0 sorts first).
+    inline Document withId(int64_t id) const;
+
+    // Whether the first field is an integer _id, which can be rewritten in
+    // place (see storeDocument).
+    bool hasIntId() const {
+        DocumentView v = view();
+        return v.size() > 0 && v.keyId(0) == FieldDictionary::kIdField && v.value(0).type() == ValueType::Int;
+    }
+
+private:
+    friend class DocumentBuilder;
+    std::string blob;
+};
+
+// Collects typed fields and encodes them. Keys are dictionary ids for
+// objects and positions for arrays; later duplicates of a key win, as with
+// JSON object assignment.
+class DocumentBuilder {
+public:
+    void addNull(uint32_t key) { addScalar(key, ValueType::Null, 0); }
+    void addBool(uint32_t key, bool v) { addScalar(key, ValueType::Bool, v); }
+    void addInt(uint32_t key, int64_t v) { addScalar(key, ValueType::Int, uint64_t(v)); }
+
+    void addDouble(uint32_t key, double v) {
+        uint64_t bits;
+        std::memcpy(&bits, &v, sizeof(bits));
+        addScalar(key, ValueType::Double, bits);
+    }
+
+    void addString(uint32_t key, std::string_view v) { addBytes(key, ValueType::String, v); }
+    void addObject(uint32_t key, const Document& v) { addBytes(key, ValueType::Object, v.bytes()); }
+    void addArray(uint32_t key, const Document& v) { addBytes(key, ValueType::Array, v.bytes()); }
+
+    // Copies a value from another document as-is.
+    void add(uint32_t key, Value v) {
+        if (doc_detail::isInline(v.type())) addScalar(key, v.type(), v.payload);
+        else addBytes(key, v.type(), v.bytes());
+    }
+
+    size_t size() const { return entries.size(); }
+
+    Document build() {
+        using namespace doc_detail;
+        std::stable_sort(entries.begin(), entries.end(),
+                         [](const Entry& a, const Entry& b) { return a.key < b.key; });
+        size_t kept = 0;
+        for (size_t i = 0; i < entries.size(); ++i)
+            if (i + 1 == entries.size() || entries[i].key != entries[i + 1].key)
+                entries[kept++] = entries[i];
+        entries.resize(kept);
+
+        size_t total = kHeaderSize + entries.size() * sizeof(Slot);
+        for (auto& e : entries)
+            if (!isInline(e.type)) total += uint32_t(e.payload);
+        if (total > UINT32_MAX) throw std::length_error("Document too large");
+
+        Document doc;
+        doc.blob.assign(total, '\0');
+        char* out = doc.blob.data();
+        store32(out, entries.size());
+        store32(out + 4, total);
+        uint64_t pos = kHeaderSize + entries.size() * sizeof(Slot);
+        for (size_t i = 0; i < entries.size(); ++i) {
+            auto& e = entries[i];
+            Slot s{e.key, uint8_t(e.type), {0, 0, 0}, e.payload};
+            if (!isInline(e.type)) {
+                uint32_t length = uint32_t(e.payload);
+                std::memcpy(out + pos, heap.data() + (e.payload >> 32), length);
+                s.payload = pos << 32 | length;
+                pos += length;
+            }
+            std::memcpy(out + kHeaderSize + i * sizeof(Slot), &s, sizeof(Slot));
+        }
+        entries.clear();
+        heap.clear();
+        return doc;
+    }
+
+private:
+    struct Entry {
+        uint32_t key;
+        ValueType type;
+        uint64_t payload;   // scalar bits, or heap offset << 32 | length
+    };
+
+    void addScalar(uint32_t key, ValueType type, uint64_t payload) {
+        entries.push_back({key, type, payload});
+    }
+
+    void addBytes(uint32_t key, ValueType type, std::string_view bytes) {
+        if (bytes.size() > UINT32_MAX) throw std::length_error("Value too large");
+        entries.push_back({key, type, uint64_t(heap.size()) << 32 | bytes.size()});
+        heap.append(bytes.data(), bytes.size());
+    }
+
+    std::vector<Entry> entries;
+    std::string heap;   // string and nested payloads, in insertion order
+};
+
+inline Document Document::withId(int64_t id) const {
+    DocumentBuilder b;
+    b.addInt(FieldDictionary::kIdField, id);
+    DocumentView v = view();
+    for (size_t i = 0, n = v.size(); i < n; ++i)
+        if (v.keyId(i) != FieldDictionary::kIdField) b.add(v.keyId(i), v.value(i));
+    return b.build();
+}
+
+// Copies a document into an arena with the given _id. A document that
+// already leads with an integer _id is copied as-is and patched.
+inline DocumentView storeDocument(Arena& arena, const Document& doc, int64_t id) {
+    if (!doc.hasIntId()) return storeDocument(arena, doc.withId(id).bytes());
+    char* p = arena.allocate(doc.bytes().size());
+    std::memcpy(p, doc.bytes().data(), doc.bytes().size());
+    std::memcpy(p + doc_detail::kHeaderSize + offsetof(doc_detail::Slot, payload), &id, sizeof(id));
+    return DocumentView(p);
+}
+
+// Total order across types: null < bool < numbers < string < object <
+// array. Ints and doubles compare by exact numeric value, with NaN before
+// every other number; nested values compare
+// by their encoded bytes, which is only meant to be consistent, not
+// meaningful.
+inline int typeRank(ValueType t) {
+    return t == ValueType::Double ? int(ValueType::Int) : int(t);
+}
+
+namespace doc_detail {
+
+inline int compareDoubles(double a, double b) {
+    if (std::isnan(a) || std::isnan(b)) return int(std::isnan(b)) - int(std::isnan(a));
+    return a < b ? -1 : a > b;
+}
+
+// Without converting i to double, which rounds above 2^53 and would make
+// two different ints equal to the same double but not to each other.
+inline int compareIntDouble(int64_t i, double d) {
+    const double kTwo63 = 9223372036854775808.0;
+    if (std::isnan(d)) return 1;
+    if (d >= kTwo63) return -1;
+    if (d < -kTwo63) return 1;
+    double whole = std::trunc(d);
+    auto w = static_cast<int64_t>(whole);
+    if (i != w) return i < w ? -1 : 1;
+    double fraction = d - whole;
+    return fraction > 0 ? -1 : fraction < 0;
+}
+
+}  // namespace doc_detail
+
+inline int compareValues(const Value& a, const Value& b) {
+    int ra = typeRank(a.type()), rb = typeRank(b.type());
+    if (ra != rb) return ra < rb ? -1 : 1;
+    switch (a.type()) {
+        case ValueType::Null: return 0;
+        case ValueType::Bool: return int(a.asBool()) - int(b.asBool());
+        case ValueType::Int:
+        case ValueType::Double:
+            if (a.type() == ValueType::Int && b.type() == ValueType::Int)
+                return a.asInt() < b.asInt() ? -1 : a.asInt() > b.asInt();
+            if (a.type() == ValueType::Int) return doc_detail::compareIntDouble(a.asInt(), b.asDouble());
+            if (b.type() == ValueType::Int) return -doc_detail::compareIntDouble(b.asInt(), a.asDouble());
+            return doc_detail::compareDoubles(a.asDouble(), b.asDouble());
+        default: {
+            int c = a.bytes().compare(b.bytes());
+            return c < 0 ? -1 : c > 0;
+        }
+    }
+}
+
+struct ValueLess {
+    bool operator()(const Value& a, const Value& b) const { return compareValues(a, b) < 0; }
+};
+
+// Hash consistent with compareValues equality: numbers hash by numeric
+// value, so 3 and 3.0 land in the same bucket.
+struct ValueHash {
+    size_t operator()(const Value& v) const {
+        switch (v.type()) {
+            case ValueType::Null: return 0;
+            case ValueType::Bool: return v.asBool() ? 1 : 2;
+            case ValueType::Int:
+            case ValueType::Double: {
+                double d = v.asDouble();
+                return std::hash<double>()(d == 0 ? 0.0 : d);
+            }
+            default: return std::hash<std::string_view>()(v.bytes()) ^ size_t(v.type());
+        }
+    }
+};
+
+struct ValueEqual {
+    bool operator()(const Value& a, const Value& b) const { return compareValues(a, b) == 0; }
+};
@@ -0,0 +1,402 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "http_parser.hpp"
+
+// === Connection ===
+// Per-socket state. Only one worker touches a connection at a time: the
+// socket is registered EPOLLONESHOT and is re-armed by the reactor only
+// after the worker has handed it back.
+struct Connection {
+    int fd = -1;
+    std::string in;          // received bytes not yet consumed by the handler
+    std::string out;         // response bytes not yet written
+    std::deque<std::string> queued;  // large pieces to write before out
+    size_t outPos = 0;       // bytes of the first unwritten piece already sent
+    bool peerClosed = false;
+    bool closeAfterWrite = false;
+    size_t requestsLeft = 0;  // keep-alive budget, set from the loop options
+    HttpParser http;          // progress through the request at the front of in
+
+    // Set by the handler to produce the rest of a response in pieces: each
+    // call appends the next piece to out and returns false after the last
+    // one. It runs on a worker whenever out has drained, so at most one
+    // piece is buffered however large the response; the handler is not
+    // called again until the stream is done.
+    std::function<bool(std::string& out)> stream;
+
+    // Set by the handler to consume the rest of a request body as it
+    // arrives instead of waiting for all of it: while set, the handler
+    // passes new input to it rather than parsing requests. It returns
+    // false once the body is done (and its response queued). Its input is
+    // not subject to maxRequestBytes.
+    std::function<bool(Connection&)> upload;
+
+    // Adds data to the output without copying it: it is written straight
+    // from its own buffer, in order after whatever out holds now.
+    void enqueue(std::string data) {
+        if (data.empty()) return;
+        if (!out.empty()) queued.push_back(std::move(out));
+        out.clear();
+        queued.push_back(std::move(data));
+    }
+
+    // Reactor-only bookkeeping for the idle timeout.
+    std::chrono::steady_clock::time_point armedAt;
+    std::list<Connection*>::iterator idlePos;
+    bool armed = false;
+};
+
+// === WorkerPool ===
+// Fixed set of threads draining a shared task queue.
+class WorkerPool {
+public:
+    explicit WorkerPool(size_t count) {
+        for (size_t i = 0; i < count; ++i)
+            threads.emplace_back([this] { run(); });
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        cv.notify_all();
+        for (auto& t : threads) t.join();
+    }
+
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            tasks.push_back(std::move(task));
+        }
+        cv.notify_one();
+    }
+
+private:
+    void run() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (tasks.empty()) return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool stopping = false;
+};
+
+// === EventLoop ===
+// Single epoll reactor thread that accepts sockets and waits for readiness;
+// the actual reads, request handling and writes happen on the worker pool.
+// Workers report back through a completion queue so the reactor stays the
+// only thread that re-arms or closes a registered socket.
+class EventLoop {
+public:
+    struct Options {
+        size_t workers = 4;
+        size_t maxConnections = 10000;
+        size_t maxRequestBytes = 64 * 1024 * 1024;
+        size_t maxRequestsPerConnection = 1000;
+        std::chrono::milliseconds idleTimeout{30000};
+    };
+
+    // Called on a worker with freshly received bytes in conn.in. The handler
+    // consumes complete requests and appends responses to conn.out, or sets
+    // conn.stream and stops.
+    using Handler = std::function<void(Connection&)>;
+
+    EventLoop(int listenFd, Options options, Handler handler)
+        : listenFd(listenFd), options(options), handler(std::move(handler)),
+          pool(options.workers) {
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        fcntl(listenFd, F_SETFL, fcntl(listenFd, F_GETFL) | O_NONBLOCK);
+
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = &this->listenFd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev);
+        ev.data.ptr = &wakeFd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev);
+    }
+
+    ~EventLoop() {
+        close(wakeFd);
+        close(epollFd);
+    }
+
+    void run() {
+        epoll_event events[256];
+        while (true) {
+            int n = epoll_wait(epollFd, events, 256, waitTimeout());
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return;
+            }
+            for (int i = 0; i < n; ++i) {
+                void* tag = events[i].data.ptr;
+                if (tag == &listenFd) acceptAll();
+                else if (tag == &wakeFd) drainCompletions();
+                else {
+                    auto* conn = static_cast<Connection*>(tag);
+                    disarm(*conn);
+                    pool.submit([this, conn] { serve(*conn); });
+                }
+            }
+            closeIdle();
+        }
+    }
+
+private:
+    enum class Next { Read, Write, Close };
+
+    void acceptAll() {
+        while (true) {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) return;   // EAGAIN, or a transient error: wait for the next event
+
+            if (active >= options.maxConnections) {
+                static const char busy[] =
+                    "HTTP/1.1 503 Service Unavailable\r\n"
+                    "Content-Length: 0\r\nConnection: close\r\n\r\n";
+                send(fd, busy, sizeof(busy) - 1, MSG_NOSIGNAL);
+                close(fd);
+                continue;
+            }
+
+            auto* conn = new Connection();
+            conn->fd = fd;
+            conn->requestsLeft = options.maxRequestsPerConnection;
+            ++active;
+            arm(*conn, EPOLLIN, EPOLL_CTL_ADD);
+        }
+    }
+
+    // Armed connections are kept in arming order, which is also expiry order
+    // since every connection gets the same idle timeout.
+    void arm(Connection& conn, uint32_t events, int op = EPOLL_CTL_MOD) {
+        epoll_event ev{};
+        ev.events = events | EPOLLONESHOT | EPOLLRDHUP;
+        ev.data.ptr = &conn;
+        epoll_ctl(epollFd, op, conn.fd, &ev);
+
+        conn.armedAt = std::chrono::steady_clock::now();
+        conn.idlePos = idle.insert(idle.end(), &conn);
+        conn.armed = true;
+    }
+
+    void disarm(Connection& conn) {
+        if (!conn.armed) return;
+        idle.erase(conn.idlePos);
+        conn.armed = false;
+    }
+
+    int waitTimeout() const {
+        if (idle.empty()) return -1;
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            idle.front()->armedAt + options.idleTimeout - std::chrono::steady_clock::now());
+        return std::max<long>(0, left.count() + 1);
+    }
+
+    void closeIdle() {
+        auto now = std::chrono::steady_clock::now();
+        while (!idle.empty() && now - idle.front()->armedAt >= options.idleTimeout) {
+            Connection& conn = *idle.front();
+            disarm(conn);
+            finish(conn);
+        }
+    }
+
+    void finish(Connection& conn) {
+        close(conn.fd);
+        delete &conn;
+        --active;
+    }
+
+    // Worker side: finish pending output, read what is available, let the
+    // handler consume it, then tell the reactor what to wait for next. A
+    // streamed response pauses the handler, so requests pipelined behind
+    // one are picked up once it has been written. Input is read at most
+    // maxRequestBytes at a time and handed to the handler before reading
+    // on, so a body the handler takes as an upload may be of any size; the
+    // limit applies to what the handler leaves buffered.
+    void serve(Connection& conn) {
+        Next next = Next::Read;
+        if (!pump(conn)) next = Next::Write;
+        else {
+            bool full;
+            do {
+                full = readAvailable(conn);
+                while (!conn.in.empty() && !conn.closeAfterWrite) {
+                    size_t before = conn.in.size();
+                    handler(conn);
+                    if (!conn.stream || conn.in.size() == before) break;
+                    if (!pump(conn)) break;
+                }
+                if (conn.in.size() > options.maxRequestBytes && !conn.upload && !conn.stream) {
+                    conn.in.clear();
+                    conn.out += "HTTP/1.1 413 Payload Too Large\r\n"
+                                "Content-Length: 0\r\nConnection: close\r\n\r\n";
+                    conn.closeAfterWrite = true;
+                }
+            } while (full && !conn.closeAfterWrite && !conn.stream && conn.in.size() <= options.maxRequestBytes);
+
+            if (!pump(conn)) next = Next::Write;
+            else if (conn.closeAfterWrite || conn.peerClosed) next = Next::Close;
+        }
+        complete(conn, next);
+    }
+
+    // Flushes output and keeps a stream going until it ends; returns false
+    // if the socket buffer filled up first.
+    bool pump(Connection& conn) {
+        while (flush(conn)) {
+            if (!conn.stream) return true;
+            try {
+                if (!conn.stream(conn.out)) conn.stream = nullptr;
+            } catch (std::exception&) {
+                // Too late for an error status: cut the response short.
+                conn.stream = nullptr;
+                conn.closeAfterWrite = true;
+            }
+        }
+        return false;
+    }
+
+    // Returns true if it stopped at maxRequestBytes with more perhaps unread.
+    bool readAvailable(Connection& conn) {
+        char buffer[16384];
+        while (conn.in.size() <= options.maxRequestBytes) {
+            ssize_t got = recv(conn.fd, buffer, sizeof(buffer), 0);
+            if (got > 0) {
+                conn.in.append(buffer, got);
+                continue;
+            }
+            if (got == 0) conn.peerClosed = true;
+            else if (errno == EINTR) continue;
+            else if (errno != EAGAIN && errno != EWOULDBLOCK) conn.peerClosed = true;
+            return false;
+        }
+        return true;
+    }
+
+    // Returns false if the socket buffer filled up before everything was sent.
+    // Queued pieces and out go out in one gathered sendmsg per round; a short
+    // write leaves outPos inside the first piece it did not finish.
+    bool flush(Connection& conn) {
+        const size_t kMaxPieces = 64;
+        while (conn.outPos < conn.out.size() || !conn.queued.empty()) {
+            iovec iov[kMaxPieces];
+            size_t count = 0;
+            for (auto& piece : conn.queued) {
+                if (count == kMaxPieces) break;
+                iov[count++] = {piece.data(), piece.size()};
+            }
+            if (count < kMaxPieces && !conn.out.empty()) iov[count++] = {conn.out.data(), conn.out.size()};
+            iov[0].iov_base = static_cast<char*>(iov[0].iov_base) + conn.outPos;
+            iov[0].iov_len -= conn.outPos;
+
+            msghdr msg{};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = count;
+            ssize_t sent = sendmsg(conn.fd, &msg, MSG_NOSIGNAL);
+            if (sent > 0) {
+                consume(conn, size_t(sent));
+                continue;
+            }
+            if (sent < 0 && errno == EINTR) continue;
+            if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return false;
+            // Broken pipe or reset: nothing more can be delivered.
+            conn.out.clear();
+            conn.queued.clear();
+            conn.outPos = 0;
+            conn.stream = nullptr;
+            conn.closeAfterWrite = true;
+            return true;
+        }
+        conn.out.clear();
+        conn.outPos = 0;
+        return true;
+    }
+
+    // Drops what sendmsg took: whole pieces from the front, then a prefix.
+    static void consume(Connection& conn, size_t sent) {
+        while (!conn.queued.empty()) {
+            size_t left = conn.queued.front().size() - conn.outPos;
+            if (sent < left) {
+                conn.outPos += sent;
+                return;
+            }
+            sent -= left;
+            conn.queued.pop_front();
+            conn.outPos = 0;
+        }
+        conn.outPos += sent;
+    }
+
+    void complete(Connection& conn, Next next) {
+        {
+            std::lock_guard<std::mutex> lock(completedMutex);
+            completed.emplace_back(&conn, next);
+        }
+        uint64_t one = 1;
+        (void)!write(wakeFd, &one, sizeof(one));
+    }
+
+    void drainCompletions() {
+        uint64_t count;
+        (void)!read(wakeFd, &count, sizeof(count));
+
+        std::vector<std::pair<Connection*, Next>> batch;
+        {
+            std::lock_guard<std::mutex> lock(completedMutex);
+            batch.swap(completed);
+        }
+        for (auto& [conn, next] : batch) {
+            if (next == Next::Close) finish(*conn);
+            else arm(*conn, next == Next::Write ? EPOLLOUT : EPOLLIN);
+        }
+    }
+
+    int listenFd;
+    int epollFd = -1;
+    int wakeFd = -1;
+    Options options;
+    Handler handler;
+    size_t active = 0;               // reactor thread only
+    std::list<Connection*> idle;     // reactor thread only
+
+    std::mutex completedMutex;
+    std::vector<std::pair<Connection*, Next>> completed;
+
+    WorkerPool pool;   // declared last so workers stop before the state they use
+};
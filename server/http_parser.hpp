@@ -0,0 +1,356 @@
+#pragma once
+
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <strings.h>
+
+// === HTTP request parsing ===
+// Requests are parsed in place in the connection's input buffer. The method,
+// path segments, query parameters and headers are views into it held in
+// fixed-size arrays, so a request is parsed without allocating. The views
+// are valid until the buffer is next modified.
+
+namespace http_detail {
+
+inline bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    return a.size() == b.size() && strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
+inline bool needsDecode(std::string_view s) { return s.find_first_of("%+") != std::string_view::npos; }
+
+inline int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+inline std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+    return s;
+}
+
+// RFC 7230 tchar: what a method or header name may consist of.
+inline bool isToken(std::string_view s) {
+    if (s.empty()) return false;
+    for (char c : s)
+        if (!isalnum(static_cast<unsigned char>(c)) && !strchr("!#$%&'*+-.^_`|~", c)) return false;
+    return true;
+}
+
+}  // namespace http_detail
+
+// '+' is a space and %XX a byte; a malformed escape is kept as it is.
+inline std::string urlDecode(std::string_view s) {
+    std::string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); ++i) {
+        int hi, lo;
+        if (s[i] == '+') out += ' ';
+        else if (s[i] == '%' && i + 2 < s.size() && (hi = http_detail::hexValue(s[i + 1])) >= 0 &&
+                 (lo = http_detail::hexValue(s[i + 2])) >= 0) {
+            out += char(hi * 16 + lo);
+            i += 2;
+        } else out += s[i];
+    }
+    return out;
+}
+
+// A path split on '/': "/user/a" is "", "user", "a" and a trailing '/' adds
+// no empty segment. Only the first kMax are kept, but size() counts all, so
+// an overlong path simply matches no route.
+class PathSegments {
+public:
+    static constexpr size_t kMax = 16;
+
+    void assign(std::string_view path) {
+        count = 0;
+        while (!path.empty()) {
+            size_t slash = path.find('/');
+            if (count < kMax) items[count] = path.substr(0, slash);
+            ++count;
+            if (slash == std::string_view::npos) break;
+            path.remove_prefix(slash + 1);
+        }
+    }
+
+    size_t size() const { return count; }
+    std::string_view operator[](size_t i) const { return i < kMax ? items[i] : std::string_view(); }
+
+private:
+    std::string_view items[kMax];
+    size_t count = 0;
+};
+
+// Query parameters, kept encoded. Pairs without '=' are ignored and a
+// repeated name takes its last value. Only names and values that contain
+// an escape are decoded, and then only when looked up.
+class QueryParams {
+public:
+    static constexpr size_t kMax = 32;
+
+    // False if there are more than kMax parameters.
+    bool assign(std::string_view query) {
+        count_ = 0;
+        while (!query.empty()) {
+            size_t amp = query.find('&');
+            std::string_view pair = query.substr(0, amp);
+            if (size_t eq = pair.find('='); eq != std::string_view::npos) {
+                if (count_ == kMax) return false;
+                items[count_++] = {pair.substr(0, eq), pair.substr(eq + 1)};
+            }
+            if (amp == std::string_view::npos) break;
+            query.remove_prefix(amp + 1);
+        }
+        return true;
+    }
+
+    size_t count(std::string_view name) const { return find(name) ? 1 : 0; }
+
+    // The decoded value, "" if absent. Most values are short enough to fit
+    // in std::string's inline buffer.
+    std::string operator[](std::string_view name) const {
+        const Param* param = find(name);
+        if (!param) return {};
+        if (http_detail::needsDecode(param->value)) return urlDecode(param->value);
+        return std::string(param->value);
+    }
+
+private:
+    struct Param {
+        std::string_view name, value;
+    };
+
+    const Param* find(std::string_view name) const {
+        for (size_t i = count_; i-- > 0;) {
+            std::string_view key = items[i].name;
+            if (http_detail::needsDecode(key) ? urlDecode(key) == name : key == name) return &items[i];
+        }
+        return nullptr;
+    }
+
+    Param items[kMax];
+    size_t count_ = 0;
+};
+
+struct HttpHeader {
+    std::string_view name, value;
+};
+
+// One parsed request head. The body, if any, follows it in the buffer:
+// headBytes in, contentLength bytes long unless chunked.
+class HttpRequest {
+public:
+    static constexpr size_t kMaxHeaders = 64;
+
+    std::string_view method, target, path, query, version;
+    PathSegments segments;
+    QueryParams params;
+    size_t headBytes = 0;
+    size_t contentLength = 0;
+    bool chunked = false;
+
+    size_t headerCount() const { return headerCount_; }
+
+    HttpHeader header(size_t i) const {
+        const Field& f = fields[i];
+        return {{base + f.name, f.nameSize}, {base + f.value, f.valueSize}};
+    }
+
+    // Case-insensitive; "" if absent.
+    std::string_view header(std::string_view name) const {
+        for (size_t i = 0; i < headerCount_; ++i) {
+            HttpHeader h = header(i);
+            if (http_detail::equalsIgnoreCase(h.name, name)) return h.value;
+        }
+        return {};
+    }
+
+    bool http10() const { return version == "HTTP/1.0"; }
+
+    // HTTP/1.1 connections persist unless the client opts out; HTTP/1.0
+    // ones only when the client asks for it.
+    bool keepAlive() const {
+        std::string_view connection = header("Connection");
+        if (http10()) return http_detail::equalsIgnoreCase(connection, "keep-alive");
+        return !http_detail::equalsIgnoreCase(connection, "close");
+    }
+
+private:
+    friend class HttpParser;
+
+    // Offsets rather than views while the head is incomplete: the buffer
+    // may move as it grows.
+    struct Field {
+        uint32_t name, nameSize, value, valueSize;
+    };
+
+    const char* base = nullptr;
+    Field fields[kMaxHeaders];
+    size_t headerCount_ = 0;
+};
+
+// Incremental parser for the request at the front of a connection's input.
+// Each call scans only the bytes added since the previous one, a line at a
+// time, and rejects a malformed request line or header as soon as it is
+// complete. Accepts CRLF or bare LF line endings and skips blank lines
+// before the request line.
+class HttpParser {
+public:
+    enum class Status { Partial, Done, Invalid };
+
+    static constexpr size_t kMaxHead = 64 * 1024;
+
+    // Call again with the same (possibly grown) buffer until Done; calling
+    // again after Done re-binds the views to the buffer's current address.
+    Status parse(std::string_view in) {
+        while (state != State::Done) {
+            if (state == State::Invalid) return Status::Invalid;
+            const void* newline = memchr(in.data() + scanned, '\n', in.size() - scanned);
+            if (!newline) {
+                if (in.size() > kMaxHead) return fail(431, "Request header too large");
+                return Status::Partial;
+            }
+            size_t end = static_cast<const char*>(newline) - in.data();
+            std::string_view line = in.substr(scanned, end - scanned);
+            size_t start = scanned;
+            scanned = end + 1;
+            if (scanned > kMaxHead) return fail(431, "Request header too large");
+            if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+
+            if (state == State::RequestLine) {
+                if (line.empty()) continue;
+                if (!requestLine(line, start)) return Status::Invalid;
+                state = State::Headers;
+            } else if (line.empty()) {
+                state = State::Done;
+                req.headBytes = scanned;
+            } else if (!headerLine(line, start)) {
+                return Status::Invalid;
+            }
+        }
+        return bind(in) ? Status::Done : Status::Invalid;
+    }
+
+    const HttpRequest& request() const { return req; }
+
+    // Why parse returned Invalid, and the status to answer with.
+    int errorStatus() const { return errorStatus_; }
+    const char* error() const { return error_; }
+
+    // Starts over for the next request, once this one has been erased from
+    // the front of the buffer.
+    void reset() {
+        state = State::RequestLine;
+        scanned = 0;
+        req.headerCount_ = 0;
+        req.headBytes = req.contentLength = 0;
+        req.chunked = false;
+        sawLength = false;
+    }
+
+private:
+    enum class State { RequestLine, Headers, Done, Invalid };
+
+    struct Span {
+        uint32_t begin = 0, size = 0;
+    };
+
+    Status fail(int status, const char* message) {
+        state = State::Invalid;
+        errorStatus_ = status;
+        error_ = message;
+        return Status::Invalid;
+    }
+
+    // METHOD SP request-target SP HTTP-version
+    bool requestLine(std::string_view line, size_t start) {
+        size_t sp1 = line.find(' ');
+        size_t sp2 = sp1 == std::string_view::npos ? sp1 : line.find(' ', sp1 + 1);
+        if (sp2 == std::string_view::npos || line.find(' ', sp2 + 1) != std::string_view::npos ||
+            !http_detail::isToken(line.substr(0, sp1)) || sp2 == sp1 + 1) {
+            fail(400, "Malformed request line");
+            return false;
+        }
+        std::string_view version = line.substr(sp2 + 1);
+        if (version != "HTTP/1.1" && version != "HTTP/1.0") {
+            fail(505, "Unsupported HTTP version");
+            return false;
+        }
+        method = {uint32_t(start), uint32_t(sp1)};
+        target = {uint32_t(start + sp1 + 1), uint32_t(sp2 - sp1 - 1)};
+        this->version = {uint32_t(start + sp2 + 1), uint32_t(version.size())};
+        return true;
+    }
+
+    // field-name ":" OWS field-value OWS; no space before the colon and no
+    // obsolete line folding, both of which RFC 7230 says to reject.
+    bool headerLine(std::string_view line, size_t start) {
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos || !http_detail::isToken(line.substr(0, colon))) {
+            fail(400, "Malformed header");
+            return false;
+        }
+        if (req.headerCount_ == HttpRequest::kMaxHeaders) {
+            fail(431, "Too many headers");
+            return false;
+        }
+        std::string_view name = line.substr(0, colon);
+        std::string_view value = http_detail::trim(line.substr(colon + 1));
+        size_t valueBegin = start + (value.data() - line.data());
+        req.fields[req.headerCount_++] = {uint32_t(start), uint32_t(name.size()), uint32_t(valueBegin),
+                                          uint32_t(value.size())};
+
+        if (http_detail::equalsIgnoreCase(name, "Content-Length")) {
+            size_t length = 0;
+            auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), length);
+            if (value.empty() || ec != std::errc() || end != value.data() + value.size() ||
+                (sawLength && length != req.contentLength)) {
+                fail(400, "Invalid Content-Length");
+                return false;
+            }
+            req.contentLength = length;
+            sawLength = true;
+        } else if (http_detail::equalsIgnoreCase(name, "Transfer-Encoding")) {
+            if (!http_detail::equalsIgnoreCase(value, "chunked")) {
+                fail(501, "Unsupported Transfer-Encoding");
+                return false;
+            }
+            req.chunked = true;
+        }
+        return true;
+    }
+
+    // Points the request's views at the buffer; a chunked body has no
+    // Content-Length, whatever the headers say.
+    bool bind(std::string_view in) {
+        auto view = [&](Span s) { return in.substr(s.begin, s.size); };
+        req.base = in.data();
+        req.method = view(method);
+        req.target = view(target);
+        req.version = view(version);
+        size_t q = req.target.find('?');
+        req.path = req.target.substr(0, q);
+        req.query = q == std::string_view::npos ? std::string_view() : req.target.substr(q + 1);
+        req.segments.assign(req.path);
+        if (req.chunked) req.contentLength = 0;
+        if (!req.params.assign(req.query)) {
+            fail(400, "Too many query parameters");
+            return false;
+        }
+        return true;
+    }
+
+    HttpRequest req;
+    State state = State::RequestLine;
+    size_t scanned = 0;   // bytes of the buffer already split into lines
+    Span method, target, version;
+    bool sawLength = false;
+    int errorStatus_ = 400;
+    const char* error_ = "";
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "document.hpp"
+
+// === Secondary indexes ===
+// Indexes map field values to rows (a row is a document's position in its
+// collection, i.e. _id - 1). They are only ever fed by the collection's
+// single writer, after the document itself is published, so any row an
+// index returns is present in a snapshot taken after the lookup.
+
+// One kind of index per field, keyed by field id. Published copy-on-write
+// like the collection registry: lookups never lock, and replaced maps are
+// retired until the set goes away. Mutations are serialized by the caller.
+template <typename Index>
+class IndexMap {
+public:
+    using Map = std::unordered_map<uint32_t, Index*>;
+
+    IndexMap() : indexes(new Map()) {}
+    IndexMap(const IndexMap&) = delete;
+    IndexMap& operator=(const IndexMap&) = delete;
+
+    ~IndexMap() {
+        const Map* current = indexes.load();
+        for (auto& [_, index] : *current) delete index;
+        delete current;
+        for (auto* map : retired) delete map;
+    }
+
+    Index* find(uint32_t field) const {
+        const Map* current = indexes.load(std::memory_order_acquire);
+        auto it = current->find(field);
+        return it == current->end() ? nullptr : it->second;
+    }
+
+    const Map& all() const { return *indexes.load(std::memory_order_acquire); }
+
+    void add(uint32_t field, std::unique_ptr<Index> index) {
+        const Map* current = indexes.load(std::memory_order_relaxed);
+        auto* next = new Map(*current);
+        (*next)[field] = index.release();
+        indexes.store(next, std::memory_order_release);
+        retired.push_back(current);
+    }
+
+private:
+    std::atomic<const Map*> indexes;
+    std::vector<const Map*> retired;
+};
+
+// Equality index: value -> rows holding it, in insertion order. Values
+// point into the collection's arena, so keys cost no copies.
+class HashIndex {
+public:
+    void add(const Value& value, size_t row) {
+        std::unique_lock<std::shared_mutex> lock(mtx);
+        rows[value].push_back(row);
+    }
+
+    std::vector<size_t> find(const Value& value) const {
+        std::shared_lock<std::shared_mutex> lock(mtx);
+        auto it = rows.find(value);
+        return it == rows.end() ? std::vector<size_t>() : it->second;
+    }
+
+private:
+    mutable std::shared_mutex mtx;
+    std::unordered_map<Value, std::vector<size_t>, ValueHash, ValueEqual> rows;
+};
+
+// Distinct values of a field with the number of rows holding each, in
+// compareValues order. The counts let a future delete drop a value once
+// its last row is gone.
+class DistinctIndex {
+public:
+    void add(const Value& value, size_t /*row*/) {
+        std::unique_lock<std::shared_mutex> lock(mtx);
+        ++counts[value];
+    }
+
+    void remove(const Value& value) {
+        std::unique_lock<std::shared_mutex> lock(mtx);
+        auto it = counts.find(value);
+        if (it != counts.end() && --it->second == 0) counts.erase(it);
+    }
+
+    std::set<Value, ValueLess> values() const {
+        std::shared_lock<std::shared_mutex> lock(mtx);
+        std::set<Value, ValueLess> out;
+        for (auto& [value, _] : counts) out.insert(out.end(), value);
+        return out;
+    }
+
+    size_t size() const {
+        std::shared_lock<std::shared_mutex> lock(mtx);
+        return counts.size();
+    }
+
+private:
+    mutable std::shared_mutex mtx;
+    std::map<Value, size_t, ValueLess> counts;
+};
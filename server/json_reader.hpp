@@ -0,0 +1,384 @@
+#pragma once
+
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "document.hpp"
+#include "json_writer.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// === JSON reader ===
+// Parses JSON text straight into a DocumentBuilder, in two passes like
+// simdjson. The first classifies the input 64 bytes at a time with bit
+// masks (quotes, backslashes, operators, whitespace) and records where each
+// token starts, skipping everything inside strings without looking at it
+// byte by byte. The second walks those positions and adds typed values:
+// strings without escapes and keys are handed over as views of the input,
+// so the only copy of a value is the one the builder makes.
+//
+// Accepts exactly RFC 8259 JSON in UTF-8. Integers that do not fit int64
+// become doubles; nesting is limited to the depth stored documents allow.
+// Errors throw std::runtime_error.
+class JsonReader {
+public:
+    explicit JsonReader(std::string_view text) : text(text) { index(); }
+
+    // Adds the fields of the top-level object to out.
+    void readObject(DocumentBuilder& out) {
+        if (peek() != '{') fail("Document must be a JSON object");
+        take();
+        readFields(out, 0);
+        finish();
+    }
+
+    // Adds the whole text, any JSON value, to out under the given key.
+    void readValue(DocumentBuilder& out, uint32_t key) {
+        size_t pos = take();
+        readValue(out, key, pos, 0);
+        finish();
+    }
+
+private:
+    static constexpr uint64_t kOddBits = 0xaaaaaaaaaaaaaaaaULL;
+
+    struct Masks {
+        uint64_t quote = 0, backslash = 0, op = 0, space = 0;
+        bool nonAscii = false;
+    };
+
+    static Masks classify(const char* block) {
+        Masks m;
+#ifdef __SSE2__
+        for (int k = 0; k < 4; ++k) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * k));
+            auto is = [&](char c) { return _mm_cmpeq_epi8(v, _mm_set1_epi8(c)); };
+            auto bits = [](__m128i x) { return uint64_t(uint32_t(_mm_movemask_epi8(x))); };
+            __m128i op = _mm_or_si128(_mm_or_si128(is('{'), is('}')), _mm_or_si128(is('['), is(']')));
+            op = _mm_or_si128(op, _mm_or_si128(is(':'), is(',')));
+            __m128i space = _mm_or_si128(_mm_or_si128(is(' '), is('\t')), _mm_or_si128(is('\n'), is('\r')));
+            m.quote |= bits(is('"')) << 16 * k;
+            m.backslash |= bits(is('\\')) << 16 * k;
+            m.op |= bits(op) << 16 * k;
+            m.space |= bits(space) << 16 * k;
+            m.nonAscii |= _mm_movemask_epi8(v) != 0;
+        }
+#else
+        for (int i = 0; i < 64; ++i) {
+            uint64_t bit = uint64_t(1) << i;
+            switch (block[i]) {
+                case '"': m.quote |= bit; break;
+                case '\\': m.backslash |= bit; break;
+                case '{': case '}': case '[': case ']': case ':': case ',': m.op |= bit; break;
+                case ' ': case '\t': case '\n': case '\r': m.space |= bit; break;
+                default: m.nonAscii |= static_cast<unsigned char>(block[i]) >= 0x80;
+            }
+        }
+#endif
+        return m;
+    }
+
+    // Bit i of the result is set when x has an odd number of bits at or
+    // below i: with quotes as x, that marks the inside of strings.
+    static uint64_t prefixXor(uint64_t x) {
+        x ^= x << 1;
+        x ^= x << 2;
+        x ^= x << 4;
+        x ^= x << 8;
+        x ^= x << 16;
+        x ^= x << 32;
+        return x;
+    }
+
+    // Characters preceded by an odd run of backslashes. Runs are told apart
+    // by subtracting each run's start from the bit past its end, which flips
+    // every other bit of the run, then comparing with odd positions.
+    static uint64_t escapedChars(uint64_t backslash, uint64_t& carry) {
+        uint64_t start = backslash & ~carry;
+        uint64_t shifted = start << 1;
+        uint64_t terminal = ((shifted | kOddBits) - start) ^ kOddBits;
+        uint64_t escaped = terminal ^ (backslash | carry);
+        carry = (terminal & backslash) >> 63;
+        return escaped;
+    }
+
+    // Pass 1: positions of every operator, opening quote and scalar start
+    // outside strings.
+    void index() {
+        uint64_t escapeCarry = 0, inStringCarry = 0, scalarCarry = 0;
+        bool nonAscii = false;
+        starts.reserve(text.size() / 4 + 2);
+        for (size_t base = 0; base < text.size(); base += 64) {
+            const char* block = text.data() + base;
+            char padded[64];
+            if (text.size() - base < 64) {
+                std::memset(padded, ' ', sizeof(padded));
+                std::memcpy(padded, block, text.size() - base);
+                block = padded;
+            }
+            Masks m = classify(block);
+            nonAscii |= m.nonAscii;
+
+            uint64_t quote = m.quote & ~escapedChars(m.backslash, escapeCarry);
+            uint64_t inString = prefixXor(quote) ^ inStringCarry;
+            inStringCarry = uint64_t(int64_t(inString) >> 63);
+
+            uint64_t scalar = ~(m.op | m.space | quote);
+            uint64_t scalarStart = scalar & ~(scalar << 1 | scalarCarry);
+            scalarCarry = scalar >> 63;
+
+            uint64_t bits = ((m.op | scalarStart) & ~inString) | (quote & inString);
+            while (bits) {
+                starts.push_back(uint32_t(base + __builtin_ctzll(bits)));
+                bits &= bits - 1;
+            }
+        }
+        if (inStringCarry) fail("Unterminated string");
+        if (nonAscii && !validUtf8()) fail("Invalid UTF-8");
+    }
+
+    bool validUtf8() const {
+        auto* p = reinterpret_cast<const unsigned char*>(text.data());
+        auto* end = p + text.size();
+        while (p < end) {
+            unsigned char c = *p;
+            if (c < 0x80) {
+                ++p;
+                continue;
+            }
+            int extra = c >= 0xf0 ? 3 : c >= 0xe0 ? 2 : c >= 0xc2 ? 1 : -1;
+            if (extra < 0 || c > 0xf4 || end - p <= extra) return false;
+            uint32_t code = c & (0x3f >> extra);
+            for (int i = 1; i <= extra; ++i) {
+                if ((p[i] & 0xc0) != 0x80) return false;
+                code = code << 6 | (p[i] & 0x3f);
+            }
+            static const uint32_t minimum[] = {0, 0x80, 0x800, 0x10000};
+            if (code < minimum[extra] || code > 0x10ffff || (code >= 0xd800 && code <= 0xdfff)) return false;
+            p += extra + 1;
+        }
+        return true;
+    }
+
+    [[noreturn]] void fail(const char* what) const { throw std::runtime_error(what); }
+
+    // Pass 2 helpers.
+    char peek() const { return next < starts.size() ? text[starts[next]] : '\0'; }
+
+    size_t take() {
+        if (next == starts.size()) fail("Unexpected end of JSON");
+        return starts[next++];
+    }
+
+    void expect(char c) {
+        if (text[take()] != c) fail("Malformed JSON");
+    }
+
+    void finish() {
+        if (next != starts.size()) fail("Unexpected data after JSON value");
+    }
+
+    bool delimiterAt(size_t pos) const {
+        if (pos == text.size()) return true;
+        switch (text[pos]) {
+            case ' ': case '\t': case '\n': case '\r':
+            case '{': case '}': case '[': case ']': case ':': case ',': return true;
+            default: return false;
+        }
+    }
+
+    void readFields(DocumentBuilder& out, int depth) {
+        if (peek() == '}') {
+            take();
+            return;
+        }
+        while (true) {
+            size_t pos = take();
+            if (text[pos] != '"') fail("Expected a field name");
+            uint32_t key = fieldNames().intern(readString(pos));
+            expect(':');
+            readValue(out, key, take(), depth);
+            char c = text[take()];
+            if (c == '}') return;
+            if (c != ',') fail("Expected ',' or '}'");
+        }
+    }
+
+    void readItems(DocumentBuilder& out, int depth) {
+        if (peek() == ']') {
+            take();
+            return;
+        }
+        for (uint32_t position = 0;; ++position) {
+            readValue(out, position, take(), depth);
+            char c = text[take()];
+            if (c == ']') return;
+            if (c != ',') fail("Expected ',' or ']'");
+        }
+    }
+
+    void readValue(DocumentBuilder& out, uint32_t key, size_t pos, int depth) {
+        switch (text[pos]) {
+            case '{':
+            case '[': {
+                if (depth >= doc_detail::kMaxDepth) fail("Document nested too deeply");
+                DocumentBuilder nested;
+                if (text[pos] == '{') {
+                    readFields(nested, depth + 1);
+                    out.addObject(key, nested.build());
+                } else {
+                    readItems(nested, depth + 1);
+                    out.addArray(key, nested.build());
+                }
+                return;
+            }
+            case '"': out.addString(key, readString(pos)); return;
+            case 't': readLiteral(pos, "true"); out.addBool(key, true); return;
+            case 'f': readLiteral(pos, "false"); out.addBool(key, false); return;
+            case 'n': readLiteral(pos, "null"); out.addNull(key); return;
+            default:
+                if (text[pos] != '-' && (text[pos] < '0' || text[pos] > '9')) fail("Unexpected character");
+                readNumber(out, key, pos);
+        }
+    }
+
+    void readLiteral(size_t pos, std::string_view literal) {
+        if (text.compare(pos, literal.size(), literal) != 0 || !delimiterAt(pos + literal.size()))
+            fail("Invalid literal");
+    }
+
+    void readNumber(DocumentBuilder& out, uint32_t key, size_t pos) {
+        auto digits = [&](size_t i) {
+            size_t from = i;
+            while (i < text.size() && text[i] >= '0' && text[i] <= '9') ++i;
+            if (i == from) fail("Invalid number");
+            return i;
+        };
+        size_t end = pos + (text[pos] == '-');
+        if (end < text.size() && text[end] == '0') ++end;
+        else end = digits(end);
+        bool integral = true;
+        if (end < text.size() && text[end] == '.') {
+            end = digits(end + 1);
+            integral = false;
+        }
+        if (end < text.size() && (text[end] == 'e' || text[end] == 'E')) {
+            ++end;
+            if (end < text.size() && (text[end] == '+' || text[end] == '-')) ++end;
+            end = digits(end);
+            integral = false;
+        }
+        if (!delimiterAt(end)) fail("Invalid number");
+
+        const char* first = text.data() + pos;
+        const char* last = text.data() + end;
+        if (integral) {
+            int64_t v;
+            auto result = std::from_chars(first, last, v);
+            if (result.ec == std::errc()) {
+                out.addInt(key, v);
+                return;
+            }
+        }
+        double d;
+        if (std::from_chars(first, last, d).ec != std::errc()) {
+            // Out of range: strtod rounds underflow to zero, overflow to inf.
+            d = std::strtod(std::string(first, last).c_str(), nullptr);
+            if (std::isinf(d)) fail("Number out of range");
+        }
+        out.addDouble(key, d);
+    }
+
+    // The string opening at pos. Plain strings are views of the input;
+    // escaped ones are decoded into a scratch buffer that stays valid until
+    // the next string is read.
+    std::string_view readString(size_t pos) {
+        const char* p = text.data() + pos + 1;
+        size_t left = text.size() - pos - 1;
+        size_t plain = json_detail::plainPrefix(p, left);
+        if (plain < left && p[plain] == '"') return {p, plain};
+
+        scratch.assign(p, plain);
+        for (size_t i = plain; i < left;) {
+            size_t run = json_detail::plainPrefix(p + i, left - i);
+            scratch.append(p + i, run);
+            i += run;
+            if (i == left) break;
+            char c = p[i];
+            if (c == '"') return scratch;
+            if (c != '\\') fail("Control character in string");
+            if (++i == left) break;
+            switch (p[i++]) {
+                case '"': scratch += '"'; break;
+                case '\\': scratch += '\\'; break;
+                case '/': scratch += '/'; break;
+                case 'b': scratch += '\b'; break;
+                case 'f': scratch += '\f'; break;
+                case 'n': scratch += '\n'; break;
+                case 'r': scratch += '\r'; break;
+                case 't': scratch += '\t'; break;
+                case 'u': i = readUnicodeEscape(p, left, i); break;
+                default: fail("Invalid escape");
+            }
+        }
+        fail("Unterminated string");
+    }
+
+    // Decodes the \uXXXX (or surrogate pair) whose digits start at i;
+    // returns the position after it.
+    size_t readUnicodeEscape(const char* p, size_t left, size_t i) {
+        auto hex4 = [&](size_t at) {
+            if (left - at < 4) fail("Invalid escape");
+            uint32_t v = 0;
+            for (size_t k = at; k < at + 4; ++k) {
+                char c = p[k];
+                int digit = c >= '0' && c <= '9' ? c - '0'
+                          : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                          : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+                if (digit < 0) fail("Invalid escape");
+                v = v << 4 | uint32_t(digit);
+            }
+            return v;
+        };
+        uint32_t code = hex4(i);
+        i += 4;
+        if (code >= 0xdc00 && code <= 0xdfff) fail("Invalid surrogate");
+        if (code >= 0xd800 && code <= 0xdbff) {
+            if (left - i < 6 || p[i] != '\\' || p[i + 1] != 'u') fail("Invalid surrogate");
+            uint32_t low = hex4(i + 2);
+            if (low < 0xdc00 || low > 0xdfff) fail("Invalid surrogate");
+            code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+            i += 6;
+        }
+        if (code < 0x80) {
+            scratch += char(code);
+        } else if (code < 0x800) {
+            scratch += char(0xc0 | code >> 6);
+            scratch += char(0x80 | (code & 0x3f));
+        } else if (code < 0x10000) {
+            scratch += char(0xe0 | code >> 12);
+            scratch += char(0x80 | (code >> 6 & 0x3f));
+            scratch += char(0x80 | (code & 0x3f));
+        } else {
+            scratch += char(0xf0 | code >> 18);
+            scratch += char(0x80 | (code >> 12 & 0x3f));
+            scratch += char(0x80 | (code >> 6 & 0x3f));
+            scratch += char(0x80 | (code & 0x3f));
+        }
+        return i;
+    }
+
+    std::string_view text;
+    std::vector<uint32_t> starts;   // token start positions from pass 1
+    size_t next = 0;                // next entry of starts to consume
+    std::string scratch;
+};
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "document.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// === JSON writer ===
+// Serializes stored values straight from their encoded blobs onto the end
+// of a caller's string: no JSON tree, no per-document temporaries, so a
+// streamed response reuses one output buffer throughout. Object keys come
+// out in field id order (so _id first), doubles in shortest round-trip
+// form with ".0" kept on integral values, and non-finite doubles as null.
+
+// Top-level fields to serialize: the listed ones plus _id (fields=), or all
+// but the listed ones (exclude=). The default keeps everything.
+struct Projection {
+    std::vector<uint32_t> ids;   // sorted field ids
+    bool include = false;
+
+    bool keeps(uint32_t id) const {
+        return std::binary_search(ids.begin(), ids.end(), id) == include;
+    }
+};
+
+namespace json_detail {
+
+inline bool needsEscape(unsigned char c) { return c < 0x20 || c == '"' || c == '\\'; }
+
+// Length of the leading run of bytes that can be copied as-is. Strings are
+// mostly plain text, so this checks 16 bytes per step where SSE2 is there.
+inline size_t plainPrefix(const char* p, size_t n) {
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1f);
+    for (; i + 16 <= n; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(bytes, quote), _mm_cmpeq_epi8(bytes, backslash));
+        // Unsigned bytes <= 0x1f are the ones max(byte, 0x1f) leaves at 0x1f.
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(_mm_max_epu8(bytes, control), control));
+        if (int mask = _mm_movemask_epi8(hit)) return i + __builtin_ctz(mask);
+    }
+#endif
+    while (i < n && !needsEscape(p[i])) ++i;
+    return i;
+}
+
+inline void appendString(std::string& out, std::string_view s) {
+    static const char hex[] = "0123456789abcdef";
+    out += '"';
+    while (true) {
+        size_t plain = plainPrefix(s.data(), s.size());
+        out.append(s.data(), plain);
+        if (plain == s.size()) break;
+        auto c = static_cast<unsigned char>(s[plain]);
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                out += "\\u00";
+                out += hex[c >> 4];
+                out += hex[c & 15];
+        }
+        s.remove_prefix(plain + 1);
+    }
+    out += '"';
+}
+
+inline void appendInt(std::string& out, int64_t v) {
+    char buffer[24];
+    auto end = std::to_chars(buffer, buffer + sizeof(buffer), v).ptr;
+    out.append(buffer, end);
+}
+
+inline void appendDouble(std::string& out, double v) {
+    if (!std::isfinite(v)) {
+        out += "null";
+        return;
+    }
+    char buffer[32];
+    auto end = std::to_chars(buffer, buffer + sizeof(buffer), v).ptr;
+    out.append(buffer, end);
+    if (std::find_if(buffer, end, [](char c) { return c == '.' || c == 'e'; }) == end) out += ".0";
+}
+
+}  // namespace json_detail
+
+inline void appendJson(std::string& out, DocumentView doc, const Projection& projection = {});
+
+inline void appendJson(std::string& out, const Value& value) {
+    switch (value.type()) {
+        case ValueType::Null: out += "null"; break;
+        case ValueType::Bool: out += value.asBool() ? "true" : "false"; break;
+        case ValueType::Int: json_detail::appendInt(out, value.asInt()); break;
+        case ValueType::Double: json_detail::appendDouble(out, value.asDouble()); break;
+        case ValueType::String: json_detail::appendString(out, value.asString()); break;
+        case ValueType::Object: appendJson(out, value.asObject()); break;
+        case ValueType::Array: {
+            DocumentView items = value.asObject();
+            out += '[';
+            for (size_t i = 0, n = items.size(); i < n; ++i) {
+                if (i) out += ',';
+                appendJson(out, items.value(i));
+            }
+            out += ']';
+            break;
+        }
+    }
+}
+
+// Skipped fields are never visited. An include list is looked up field by
+// field, so picking 2 of 40 fields touches only those 2.
+inline void appendJson(std::string& out, DocumentView doc, const Projection& projection) {
+    bool first = true;
+    auto field = [&](std::string_view key, const Value& value) {
+        out += first ? '{' : ',';
+        first = false;
+        json_detail::appendString(out, key);
+        out += ':';
+        appendJson(out, value);
+    };
+    if (projection.include) {
+        for (uint32_t id : projection.ids)
+            if (auto value = doc.get(id)) field(fieldNames().name(id), *value);
+    } else {
+        for (size_t i = 0, n = doc.size(); i < n; ++i)
+            if (projection.keeps(doc.keyId(i))) field(doc.key(i), doc.value(i));
+    }
+    out += first ? "{}" : "}";
+}
@@ -4,143 +4,849 @@
 #include <set>
 #include <optional>
 #include <cstdlib>
+#include <charconv>
 #include <iostream>
 #include <map>
 #include <sstream>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <shared_mutex>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <random>
+#include <sys/stat.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <unistd.h>
 #include <cstring>
+#include <strings.h>
 #include <arpa/inet.h>
 
 #include "json.hpp" // <-- Download json.hpp and place in your directory
+#include "event_loop.hpp"
+#include "chunked_vector.hpp"
+#include "document.hpp"
+#include "wal.hpp"
+#include "checkpoint.hpp"
+#include "column.hpp"
+#include "aggregate.hpp"
+#include "index.hpp"
+#include "btree.hpp"
+#include "sketch.hpp"
+#include "json_writer.hpp"
+#include "json_reader.hpp"
+#include "compression.hpp"
+#include "router.hpp"
 
 using json = nlohmann::json;
 using namespace std;
 
-using Document = unordered_map<string, string>;
-
 // === Collection ===
+// Documents are kept in a ChunkedVector: readers pin a snapshot and scan it
+// without locking, while inserts (serialized by writeMutex) keep appending.
+// The encoded documents themselves live in the collection's arena.
+// A document's _id is its position + 1.
+//
+// Secondary structures (indexes) are derived from the documents: they are
+// built on request from whatever is already stored, then kept current by
+// every insert under the same write lock.
+enum class IndexKind : uint8_t { Column = 1, Hash = 2, BTree = 3, Distinct = 4, Sketch = 5 };
+
+// An index definition as logged and checkpointed. Only sketches take a
+// parameter (their precision), and only they store it.
+struct IndexSpec {
+    IndexKind kind;
+    string field;
+    uint32_t param = 0;
+
+    void write(ByteWriter& w) const {
+        w.u8(uint8_t(kind));
+        w.str(field);
+        if (kind == IndexKind::Sketch) w.u32(param);
+    }
+
+    static IndexSpec read(ByteReader& r) {
+        IndexSpec spec{IndexKind(r.u8()), string(r.str())};
+        if (spec.kind == IndexKind::Sketch) spec.param = r.u32();
+        return spec;
+    }
+};
+
+// A range of field values. Comparison is typed: a range bounded on one
+// side only stays within that bound's type, so "age >= 30" skips strings.
+struct ValueRange {
+    struct Bound {
+        Value value;
+        bool inclusive;
+    };
+    optional<Bound> lower, upper;
+
+    // True for the values ordered before the range.
+    bool below(const Value& v) const {
+        if (lower) {
+            int c = compareValues(v, lower->value);
+            return c < 0 || (c == 0 && !lower->inclusive);
+        }
+        return upper && typeRank(v.type()) < typeRank(upper->value.type());
+    }
+
+    // True for the values not ordered past the range.
+    bool within(const Value& v) const {
+        if (upper) {
+            int c = compareValues(v, upper->value);
+            return c < 0 || (c == 0 && upper->inclusive);
+        }
+        return !lower || typeRank(v.type()) <= typeRank(lower->value.type());
+    }
+
+    bool contains(const Value& v) const { return !below(v) && within(v); }
+};
+
 class Collection {
 public:
-    void insert(Document doc) {
-        doc["_id"] = to_string(nextId++);
-        documents.push_back(doc);
+    using Snapshot = ChunkedVector<DocumentView>::Snapshot;
+    // Runs under the write lock so log order matches _id order; returns the LSN.
+    using LogFn = function<uint64_t(DocumentView)>;
+
+    uint64_t insert(const Document& doc, const LogFn& log = nullptr) {
+        lock_guard<mutex> lock(writeMutex);
+        return insertLocked(doc, log);
+    }
+
+    // Inserts in order under one acquisition of the write lock; returns the
+    // LSN of the last document.
+    uint64_t insertBatch(const vector<Document>& docs, const LogFn& log = nullptr) {
+        lock_guard<mutex> lock(writeMutex);
+        uint64_t lsn = 0;
+        for (auto& doc : docs) lsn = insertLocked(doc, log);
+        return lsn;
+    }
+
+    // Inserts documents that keep the _id they were exported with. Ones
+    // already present (_id up to the current count) are skipped, so an
+    // interrupted import can be resent from any earlier point; a gap in
+    // the ids fails the whole batch. Returns the number inserted and the
+    // LSN of the last one.
+    pair<size_t, uint64_t> importBatch(const vector<Document>& docs, const LogFn& log = nullptr) {
+        lock_guard<mutex> lock(writeMutex);
+        int64_t next = documents.size() + 1;
+        for (auto& doc : docs) {
+            if (!doc.hasIntId()) throw runtime_error("Imported documents need an integer _id");
+            int64_t id = doc.view().value(0).asInt();
+            if (id > next) throw runtime_error("Missing _id " + to_string(next));
+            if (id == next) ++next;
+        }
+        size_t added = 0;
+        uint64_t lsn = 0;
+        for (auto& doc : docs) {
+            if (doc.view().value(0).asInt() <= int64_t(documents.size())) continue;
+            lsn = insertLocked(doc, log);
+            ++added;
+        }
+        return {added, lsn};
+    }
+
+    // Appends an already encoded document that carries its own _id, as
+    // read back from the WAL or a checkpoint.
+    void restore(string_view bytes) {
+        if (!DocumentView::valid(bytes)) throw runtime_error("Malformed document");
+        lock_guard<mutex> lock(writeMutex);
+        append(storeDocument(arena, bytes));
+    }
+
+    // Returns false if the field already has an index of that kind.
+    bool createIndex(const IndexSpec& spec) {
+        uint32_t id = fieldNames().intern(spec.field);
+        lock_guard<mutex> lock(writeMutex);
+        switch (spec.kind) {
+            case IndexKind::Column: return columns.add(id, documents.snapshot());
+            case IndexKind::Hash: return buildIndex(hashIndexes, id);
+            case IndexKind::BTree: return buildIndex(btreeIndexes, id);
+            case IndexKind::Distinct: return buildIndex(distinctIndexes, id);
+            case IndexKind::Sketch: {
+                uint32_t precision = min(HyperLogLog::kMaxPrecision, max(HyperLogLog::kMinPrecision, spec.param));
+                return buildIndex(sketches, id, precision);
+            }
+        }
+        throw runtime_error("Unknown index kind");
+    }
+
+    vector<IndexSpec> indexes() const {
+        vector<IndexSpec> found;
+        auto name = [](uint32_t id) { return string(fieldNames().name(id)); };
+        for (uint32_t id : columns.fields()) found.push_back({IndexKind::Column, name(id)});
+        for (auto& [id, _] : hashIndexes.all()) found.push_back({IndexKind::Hash, name(id)});
+        for (auto& [id, _] : btreeIndexes.all()) found.push_back({IndexKind::BTree, name(id)});
+        for (auto& [id, _] : distinctIndexes.all()) found.push_back({IndexKind::Distinct, name(id)});
+        for (auto& [id, sketch] : sketches.all())
+            found.push_back({IndexKind::Sketch, name(id), sketch->precisionBits()});
+        return found;
+    }
+
+    Snapshot findAll() const { return documents.snapshot(); }
+
+    // Documents whose field equals value (compareValues equality), in _id
+    // order. Uses a hash index on the field if there is one.
+    vector<DocumentView> find(const string& key, const Value& value) const {
+        vector<DocumentView> found;
+        auto id = fieldNames().find(key);
+        if (!id) return found;
+        if (HashIndex* index = hashIndexes.find(*id)) {
+            vector<size_t> rows = index->find(value);
+            Snapshot docs = documents.snapshot();
+            for (size_t row : rows) found.push_back(docs[row]);
+            return found;
+        }
+        documents.snapshot().forEach([&](DocumentView doc) {
+            auto v = doc.get(*id);
+            if (v && compareValues(*v, value) == 0) found.push_back(doc);
+        });
+        return found;
     }
 
-    vector<Document> findAll() const { return documents; }
+    // Documents whose field lies in the range, ordered by that field (ties
+    // in _id order, reversed when descending), at most limit of them. Uses a
+    // B-tree index on the field if there is one, else scans and sorts.
+    vector<DocumentView> range(const string& key, const ValueRange& range, bool descending, size_t limit) const {
+        vector<DocumentView> found;
+        auto id = fieldNames().find(key);
+        if (!id) return found;
+        if (BTreeIndex* index = btreeIndexes.find(*id)) {
+            auto below = [&](const Value& v) { return range.below(v); };
+            auto within = [&](const Value& v) { return range.within(v); };
+            vector<size_t> rows = index->scan(below, within, descending, limit);
+            Snapshot docs = documents.snapshot();
+            for (size_t row : rows) found.push_back(docs[row]);
+            return found;
+        }
+        vector<pair<Value, DocumentView>> matches;
+        documents.snapshot().forEach([&](DocumentView doc) {
+            auto v = doc.get(*id);
+            if (v && range.contains(*v)) matches.emplace_back(*v, doc);
+        });
+        stable_sort(matches.begin(), matches.end(),
+                    [](auto& a, auto& b) { return compareValues(a.first, b.first) < 0; });
+        if (descending) reverse(matches.begin(), matches.end());
+        for (size_t i = 0; i < matches.size() && i < limit; ++i) found.push_back(matches[i].second);
+        return found;
+    }
+
+    size_t countRange(const string& key, const ValueRange& range) const {
+        auto id = fieldNames().find(key);
+        if (!id) return 0;
+        if (BTreeIndex* index = btreeIndexes.find(*id)) {
+            size_t end = index->countPrefix([&](const Value& v) { return range.within(v); });
+            size_t begin = index->countPrefix([&](const Value& v) { return range.below(v); });
+            return end > begin ? end - begin : 0;
+        }
+        size_t n = 0;
+        documents.snapshot().forEach([&](DocumentView doc) {
+            auto v = doc.get(*id);
+            if (v && range.contains(*v)) ++n;
+        });
+        return n;
+    }
+
+    // Like findAll(), but waits out an in-flight insert, so every insert
+    // already in the WAL is part of the snapshot.
+    Snapshot checkpointSnapshot() {
+        lock_guard<mutex> lock(writeMutex);
+        return documents.snapshot();
+    }
 
     int countDocuments() const { return documents.size(); }
 
-    int sum(const string& key) const {
-        int total = 0;
-        for (const auto& doc : documents)
-            if (doc.count(key)) total += atoi(doc.at(key).c_str());
+    // Count, sum, min and max of the numeric values of a field. Int and
+    // Double values are aggregated separately; with a column, all of them
+    // land on the column's side.
+    struct Stats {
+        IntAggregate ints;
+        DoubleAggregate doubles;
+
+        uint64_t count() const { return ints.count + doubles.count; }
+    };
+
+    Stats stats(const string& key) const {
+        Stats total;
+        auto id = fieldNames().find(key);
+        if (!id) return total;
+        if (const Column* column = columns.find(*id)) {
+            if (column->type == ColumnType::Int) total.ints = aggregate(column->ints.view());
+            else total.doubles = aggregate(column->doubles.view());
+            return total;
+        }
+        documents.snapshot().forEach([&](DocumentView doc) {
+            auto value = doc.get(*id);
+            if (!value) return;
+            if (value->type() == ValueType::Int) total.ints.add(value->asInt());
+            else if (value->type() == ValueType::Double) total.doubles.add(value->asDouble());
+        });
         return total;
     }
 
-    set<string> distinct(const string& key) const {
-        set<string> values;
-        for (const auto& doc : documents)
-            if (doc.count(key)) values.insert(doc.at(key));
+    // Distinct values of a field, in compareValues order. The values point
+    // into the collection's arena, which outlives any caller.
+    set<Value, ValueLess> distinct(const string& key) const {
+        set<Value, ValueLess> values;
+        auto id = fieldNames().find(key);
+        if (!id) return values;
+        if (DistinctIndex* index = distinctIndexes.find(*id)) return index->values();
+        documents.snapshot().forEach([&](DocumentView doc) {
+            if (auto value = doc.get(*id)) values.insert(*value);
+        });
         return values;
     }
 
+    size_t distinctCount(const string& key) const {
+        auto id = fieldNames().find(key);
+        DistinctIndex* index = id ? distinctIndexes.find(*id) : nullptr;
+        return index ? index->size() : distinct(key).size();
+    }
+
+    // HyperLogLog estimate; nullopt if the field has no sketch.
+    optional<uint64_t> approxDistinctCount(const string& key) const {
+        auto id = fieldNames().find(key);
+        HyperLogLog* sketch = id ? sketches.find(*id) : nullptr;
+        if (!sketch) return nullopt;
+        return sketch->estimate();
+    }
+
 private:
-    vector<Document> documents;
-    int nextId = 1;
+    uint64_t insertLocked(const Document& doc, const LogFn& log) {
+        DocumentView view = storeDocument(arena, doc, documents.size() + 1);
+        uint64_t lsn = log ? log(view) : 0;
+        append(view);
+        return lsn;
+    }
+
+    // Publishes a stored document and feeds it to every index.
+    void append(DocumentView doc) {
+        size_t row = documents.size();
+        documents.push_back(doc);
+        columns.append(doc);
+        feedIndexes(hashIndexes, doc, row);
+        feedIndexes(btreeIndexes, doc, row);
+        feedIndexes(distinctIndexes, doc, row);
+        feedIndexes(sketches, doc, row);
+    }
+
+    template <typename Index>
+    static void feedIndexes(const IndexMap<Index>& indexes, DocumentView doc, size_t row) {
+        for (auto& [id, index] : indexes.all())
+            if (auto value = doc.get(id)) index->add(*value, row);
+    }
+
+    // Builds an index from the stored documents; false if one exists.
+    template <typename Index, typename... Args>
+    bool buildIndex(IndexMap<Index>& indexes, uint32_t id, Args... args) {
+        if (indexes.find(id)) return false;
+        auto index = make_unique<Index>(args...);
+        size_t row = 0;
+        documents.snapshot().forEach([&](DocumentView doc) {
+            if (auto value = doc.get(id)) index->add(*value, row);
+            ++row;
+        });
+        indexes.add(id, move(index));
+        return true;
+    }
+
+    mutex writeMutex;
+    Arena arena;
+    ChunkedVector<DocumentView> documents;
+    ColumnSet columns;
+    IndexMap<HashIndex> hashIndexes;
+    IndexMap<BTreeIndex> btreeIndexes;
+    IndexMap<DistinctIndex> distinctIndexes;
+    IndexMap<HyperLogLog> sketches;
 };
 
+// The collection registry is read far more often than it changes, so it is
+// published copy-on-write: readers load the current map with one atomic
+// load and never lock. Replaced maps are retired rather than freed, because
+// a reader may still be walking one; collections are created rarely enough
+// that keeping them until the UserDB goes away is cheap.
 class UserDB {
 public:
-    void createCollection(const string& name) {
-        if (!collections.count(name))
-            collections[name] = Collection();
+    using CollectionMap = unordered_map<string, shared_ptr<Collection>>;
+
+    UserDB() : collections(new CollectionMap()) {}
+
+    ~UserDB() {
+        delete collections.load();
+        for (auto* map : retired) delete map;
     }
 
-    Collection& getCollection(const string& name) {
-        return collections.at(name);
+    // Returns false if the collection already existed.
+    bool createCollection(const string& name) {
+        if (findCollection(name)) return false;
+        lock_guard<mutex> lock(writeMutex);
+        const CollectionMap* current = collections.load(memory_order_relaxed);
+        if (current->count(name)) return false;
+        auto* next = new CollectionMap(*current);
+        (*next)[name] = make_shared<Collection>();
+        collections.store(next, memory_order_release);
+        retired.push_back(current);
+        return true;
     }
 
-    const Collection& getCollection(const string& name) const {
-        return collections.at(name);
+    Collection* findCollection(const string& name) const {
+        const CollectionMap* current = collections.load(memory_order_acquire);
+        auto it = current->find(name);
+        return it == current->end() ? nullptr : it->second.get();
+    }
+
+    Collection& getCollection(const string& name) const {
+        if (auto* col = findCollection(name)) return *col;
+        throw out_of_range("Unknown collection");
     }
 
     set<string> listCollections() const {
         set<string> keys;
-        for (const auto& [name, _] : collections) keys.insert(name);
+        for (const auto& [name, _] : *collections.load(memory_order_acquire)) keys.insert(name);
         return keys;
     }
 
 private:
-    unordered_map<string, Collection> collections;
+    atomic<const CollectionMap*> collections;
+    mutex writeMutex;
+    vector<const CollectionMap*> retired;
 };
 
+// WAL record kinds. Inserts carry the encoded document with its assigned
+// _id; FieldName records precede the first document that uses a new key.
+// CreateIndex carries the index kind and field name.
+enum class LogOp : uint8_t { CreateUser = 1, CreateCollection = 2, Insert = 3, FieldName = 4, CreateIndex = 5 };
+
+// Users are looked up under a shared lock and only added under an exclusive
+// one; UserDB objects never move once created.
+//
+// With a WAL attached, every mutation is logged and committed before the
+// call returns (how durable that is depends on the log's mode).
 class System {
 public:
-    void createUser(const string& user) {
-        if (!users.count(user)) users[user] = UserDB();
+    UserDB& createUser(const string& user) {
+        if (auto* db = findUser(user)) return *db;
+        uint64_t lsn = 0;
+        UserDB* db;
+        {
+            unique_lock<shared_mutex> lock(usersMutex);
+            auto& slot = users[user];
+            if (!slot) {
+                slot = make_unique<UserDB>();
+                lsn = log(LogOp::CreateUser, user);
+            }
+            db = slot.get();
+        }
+        commit(lsn);
+        return *db;
     }
 
     void createCollection(const string& user, const string& col) {
-        users[user].createCollection(col);
+        if (createUser(user).createCollection(col))
+            commit(log(LogOp::CreateCollection, user, col));
     }
 
     void insertDocument(const string& user, const string& col, const Document& doc) {
-        users[user].getCollection(col).insert(doc);
+        Collection& collection = getUser(user).getCollection(col);
+        if (!wal) {
+            collection.insert(doc);
+            return;
+        }
+        commit(collection.insert(doc, [&](DocumentView stored) {
+            return log(LogOp::Insert, user, col, stored.bytes());
+        }));
+    }
+
+    // One lock acquisition and one commit wait for the whole batch.
+    void insertDocuments(const string& user, const string& col, const vector<Document>& docs) {
+        Collection& collection = getUser(user).getCollection(col);
+        if (!wal) {
+            collection.insertBatch(docs);
+            return;
+        }
+        commit(collection.insertBatch(docs, [&](DocumentView stored) {
+            return log(LogOp::Insert, user, col, stored.bytes());
+        }));
+    }
+
+    // Like insertDocuments, keeping each document's _id (see
+    // Collection::importBatch); returns the number inserted.
+    size_t importDocuments(const string& user, const string& col, const vector<Document>& docs) {
+        Collection& collection = getUser(user).getCollection(col);
+        if (!wal) return collection.importBatch(docs).first;
+        auto [added, lsn] = collection.importBatch(docs, [&](DocumentView stored) {
+            return log(LogOp::Insert, user, col, stored.bytes());
+        });
+        commit(lsn);
+        return added;
+    }
+
+    void createIndex(const string& user, const string& col, const IndexSpec& spec) {
+        if (!getUser(user).getCollection(col).createIndex(spec)) return;
+        string payload;
+        ByteWriter w(payload);
+        spec.write(w);
+        commit(log(LogOp::CreateIndex, user, col, payload));
+    }
+
+    Collection::Snapshot getDocuments(const string& user, const string& col) const {
+        return getUser(user).getCollection(col).findAll();
+    }
+
+    vector<DocumentView> findDocuments(const string& user, const string& col, const string& key, const Value& value) const {
+        return getUser(user).getCollection(col).find(key, value);
     }
 
-    vector<Document> getDocuments(const string& user, const string& col) const {
-        return users.at(user).getCollection(col).findAll();
+    vector<DocumentView> rangeDocuments(const string& user, const string& col, const string& key,
+                                        const ValueRange& range, bool descending, size_t limit) const {
+        return getUser(user).getCollection(col).range(key, range, descending, limit);
+    }
+
+    size_t countRange(const string& user, const string& col, const string& key, const ValueRange& range) const {
+        return getUser(user).getCollection(col).countRange(key, range);
     }
 
     int countDocuments(const string& user, const string& col) const {
-        return users.at(user).getCollection(col).countDocuments();
+        return getUser(user).getCollection(col).countDocuments();
+    }
+
+    Collection::Stats fieldStats(const string& user, const string& col, const string& key) const {
+        return getUser(user).getCollection(col).stats(key);
+    }
+
+    set<Value, ValueLess> distinctValues(const string& user, const string& col, const string& key) const {
+        return getUser(user).getCollection(col).distinct(key);
     }
 
-    int sumField(const string& user, const string& col, const string& key) const {
-        return users.at(user).getCollection(col).sum(key);
+    size_t distinctCount(const string& user, const string& col, const string& key) const {
+        return getUser(user).getCollection(col).distinctCount(key);
     }
 
-    set<string> distinctValues(const string& user, const string& col, const string& key) const {
-        return users.at(user).getCollection(col).distinct(key);
+    optional<uint64_t> approxDistinctCount(const string& user, const string& col, const string& key) const {
+        return getUser(user).getCollection(col).approxDistinctCount(key);
     }
 
     set<string> listCollections(const string& user) const {
-        return users.at(user).listCollections();
+        return getUser(user).listCollections();
+    }
+
+    // Rebuilds state from the log, then starts logging new mutations to it.
+    // Inserts already covered by the checkpoint (by _id) are skipped.
+    void recover(WriteAheadLog& log, uint64_t fromSeq) {
+        log.replay(fromSeq, [this](string_view record) {
+            ByteReader r(record);
+            auto op = LogOp(r.u8());
+            if (op == LogOp::FieldName) {
+                uint32_t id = r.u32();
+                fieldNames().restore(id, r.str());
+                return;
+            }
+            string user(r.str());
+            if (op == LogOp::CreateUser) {
+                createUser(user);
+                return;
+            }
+            string col(r.str());
+            createCollection(user, col);
+            Collection& collection = getUser(user).getCollection(col);
+            if (op == LogOp::CreateIndex) {
+                ByteReader index(r.str());
+                collection.createIndex(IndexSpec::read(index));
+                return;
+            }
+            if (op != LogOp::Insert) return;
+            string_view bytes = r.str();
+            if (!DocumentView::valid(bytes)) throw runtime_error("Malformed document in WAL");
+            auto id = DocumentView(bytes.data()).get(FieldDictionary::kIdField);
+            if (id && id->asInt() > collection.countDocuments())
+                collection.restore(bytes);
+        });
+        wal = &log;
+        fieldNames().onIntern = [this](uint32_t id, string_view name) {
+            string record;
+            ByteWriter w(record);
+            w.u8(uint8_t(LogOp::FieldName));
+            w.u32(id);
+            w.str(name);
+            wal->append(record);
+        };
+    }
+
+    // Writes every collection to a checkpoint file and drops the WAL
+    // segments it makes redundant. Runs alongside writers: collections are
+    // read through MVCC snapshots, and a WAL rotation marks which log
+    // records the checkpoint is guaranteed to contain.
+    void checkpoint(const string& path) {
+        uint64_t seq = wal->rotate();
+
+        vector<pair<string, UserDB*>> userList;
+        {
+            shared_lock<shared_mutex> lock(usersMutex);
+            for (auto& [name, userDb] : users) userList.emplace_back(name, userDb.get());
+        }
+
+        struct Pinned {
+            string user, col;
+            Collection::Snapshot snapshot;
+            vector<IndexSpec> indexes;
+        };
+        vector<Pinned> pinned;
+        for (auto& [user, userDb] : userList)
+            for (auto& col : userDb->listCollections()) {
+                Collection& collection = userDb->getCollection(col);
+                pinned.push_back({user, col, collection.checkpointSnapshot(), collection.indexes()});
+            }
+
+        // Section 0: field names (read after pinning, so it covers every key
+        // used by the pinned documents), then users.
+        CheckpointWriter out(path, seq);
+        string bytes;
+        ByteWriter w(bytes);
+        uint32_t names = fieldNames().size();
+        w.u32(names);
+        for (uint32_t id = 0; id < names; ++id) w.str(fieldNames().name(id));
+        w.u32(userList.size());
+        for (auto& [name, _] : userList) w.str(name);
+        out.beginSection();
+        out.write(bytes);
+        out.endSection();
+
+        // Collection sections: documents, then the index definitions, which
+        // are rebuilt on load rather than stored.
+        for (auto& [user, col, snapshot, indexes] : pinned) {
+            bytes.clear();
+            w.str(user);
+            w.str(col);
+            w.u64(snapshot.size());
+            out.beginSection();
+            snapshot.forEach([&](DocumentView doc) {
+                w.str(doc.bytes());
+                if (bytes.size() >= 65536) {
+                    out.write(bytes);
+                    bytes.clear();
+                }
+            });
+            w.u32(indexes.size());
+            for (auto& spec : indexes) spec.write(w);
+            out.write(bytes);
+            out.endSection();
+        }
+        out.finish();
+        wal->dropSegmentsBefore(seq);
+    }
+
+    // Loads a checkpoint, one collection per task across all cores, and
+    // returns the first WAL segment that still needs replaying.
+    uint64_t loadCheckpoint(const string& path) {
+        CheckpointReader in(path);
+        if (in.sections() == 0) return in.walSeq();
+
+        ByteReader header(in.section(0));
+        uint32_t names = header.u32();
+        for (uint32_t id = 0; id < names; ++id) fieldNames().restore(id, header.str());
+        for (uint32_t n = header.u32(); n > 0; --n) createUser(string(header.str()));
+
+        atomic<size_t> next{1};
+        exception_ptr failure;
+        mutex failureMutex;
+        auto work = [&] {
+            try {
+                for (size_t i; (i = next++) < in.sections();) {
+                    ByteReader r(in.section(i));
+                    string user(r.str()), col(r.str());
+                    createCollection(user, col);
+                    Collection& collection = getUser(user).getCollection(col);
+                    for (uint64_t n = r.u64(); n > 0; --n) collection.restore(r.str());
+                    for (uint32_t n = r.done() ? 0 : r.u32(); n > 0; --n)
+                        collection.createIndex(IndexSpec::read(r));
+                }
+            } catch (...) {
+                lock_guard<mutex> lock(failureMutex);
+                failure = current_exception();
+            }
+        };
+        vector<thread> threads;
+        size_t count = min<size_t>(max(1u, thread::hardware_concurrency()), in.sections() - 1);
+        for (size_t t = 0; t < count; ++t) threads.emplace_back(work);
+        for (auto& t : threads) t.join();
+        if (failure) rethrow_exception(failure);
+        return in.walSeq();
+    }
+private:
+    uint64_t log(LogOp op, string_view user, string_view col = {}, string_view payload = {}) {
+        if (!wal) return 0;
+        string record;
+        ByteWriter w(record);
+        w.u8(uint8_t(op));
+        w.str(user);
+        if (op != LogOp::CreateUser) w.str(col);
+        if (op == LogOp::Insert || op == LogOp::CreateIndex) w.str(payload);
+        return wal->append(record);
+    }
+
+    void commit(uint64_t lsn) {
+        if (wal && lsn) wal->commit(lsn);
+    }
+
+    UserDB* findUser(const string& user) const {
+        shared_lock<shared_mutex> lock(usersMutex);
+        auto it = users.find(user);
+        return it == users.end() ? nullptr : it->second.get();
+    }
+
+    UserDB& getUser(const string& user) const {
+        if (auto* db = findUser(user)) return *db;
+        throw out_of_range("Unknown user");
+    }
+
+    mutable shared_mutex usersMutex;
+    unordered_map<string, unique_ptr<UserDB>> users;
+    WriteAheadLog* wal = nullptr;
+};
+
+// === Cursors ===
+// Server-side paging state: a pinned snapshot plus the next row to hand
+// out. Pages are read straight from the snapshot, so each costs O(page),
+// and the listing stays stable while inserts continue. A cursor unused
+// for `timeout` expires; one that runs out is dropped at its last page.
+class CursorTable {
+public:
+    struct Page {
+        Collection::Snapshot docs;
+        size_t begin = 0, end = 0;
+        bool more = false;   // the cursor lives on for another page
+    };
+
+    chrono::seconds timeout{60};
+
+    string open(Collection::Snapshot docs, size_t start, size_t pageSize) {
+        lock_guard<mutex> lock(mtx);
+        expire();
+        char id[33];
+        snprintf(id, sizeof(id), "%016llx%016llx", (unsigned long long)rng(), (unsigned long long)rng());
+        cursors[id] = {docs, start, max<size_t>(1, pageSize), chrono::steady_clock::now()};
+        return id;
+    }
+
+    // Claims the next page; throws if the cursor is unknown or expired.
+    Page next(const string& id) {
+        lock_guard<mutex> lock(mtx);
+        expire();
+        auto it = cursors.find(id);
+        if (it == cursors.end()) throw out_of_range("Unknown or expired cursor");
+        Cursor& cursor = it->second;
+        Page page{cursor.docs, cursor.next, cursor.next + min(cursor.docs.size() - cursor.next, cursor.pageSize)};
+        cursor.next = page.end;
+        cursor.lastUsed = chrono::steady_clock::now();
+        page.more = page.end < cursor.docs.size();
+        if (!page.more) cursors.erase(it);
+        return page;
     }
 
 private:
-    unordered_map<string, UserDB> users;
+    struct Cursor {
+        Collection::Snapshot docs;
+        size_t next;
+        size_t pageSize;
+        chrono::steady_clock::time_point lastUsed;
+    };
+
+    void expire() {
+        auto now = chrono::steady_clock::now();
+        for (auto it = cursors.begin(); it != cursors.end();)
+            it = now - it->second.lastUsed >= timeout ? cursors.erase(it) : std::next(it);
+    }
+
+    mutex mtx;
+    mt19937_64 rng{random_device()()};
+    unordered_map<string, Cursor> cursors;
 };
 
-// JSON utils
-string toJson(const Document& doc) {
-    json j(doc);
-    return j.dump();
+// JSON utils (documents are written by appendJson, see json_writer.hpp)
+
+// Produces a response body in pieces (see Connection::stream): appends the
+// next piece to out, returns false once the body is complete.
+using BodyStream = function<bool(string& out)>;
+
+// Streams a snapshot as a JSON array, about kStreamPiece bytes at a time.
+const size_t kStreamPiece = 64 * 1024;
+
+BodyStream streamJsonArray(Collection::Snapshot docs, size_t begin, size_t end, Projection projection) {
+    return [docs, begin, end, projection, next = begin, opened = false](string& out) mutable {
+        if (!opened) out += '[';
+        opened = true;
+        size_t start = out.size();
+        for (; next < end && out.size() - start < kStreamPiece; ++next) {
+            if (next > begin) out += ',';
+            appendJson(out, docs[next], projection);
+        }
+        if (next < end) return true;
+        out += ']';
+        return false;
+    };
 }
 
-string toJsonArray(const vector<Document>& docs) {
-    json j = json::array();
-    for (auto& doc : docs) j.push_back(doc);
-    return j.dump();
+// Streams documents from begin on as NDJSON, one per line, passed through
+// the compressor if there is one.
+BodyStream streamNdjson(Collection::Snapshot docs, size_t begin, shared_ptr<StreamCodec> codec) {
+    return [docs, codec, next = begin, lines = string()](string& out) mutable {
+        string& text = codec ? lines : out;
+        size_t start = text.size();
+        for (; next < docs.size() && text.size() - start < kStreamPiece; ++next) {
+            appendJson(text, docs[next]);
+            text += '\n';
+        }
+        bool more = next < docs.size();
+        if (codec) {
+            codec->write(lines, out);
+            lines.clear();
+            if (!more) codec->finish(out);
+        }
+        return more;
+    };
 }
 
-// HTTP helpers
-unordered_map<string, string> parseQuery(const string& query) {
-    unordered_map<string, string> params;
-    istringstream ss(query);
-    string pair;
-    while (getline(ss, pair, '&')) {
-        size_t eq = pair.find('=');
-        if (eq != string::npos)
-            params[pair.substr(0, eq)] = pair.substr(eq + 1);
+// {"cursor": id or null once exhausted, "documents": [...]}
+string toJsonPage(const CursorTable::Page& page, const string& id, const Projection& projection) {
+    string out = page.more ? "{\"cursor\": \"" + id + "\", \"documents\": [" : "{\"cursor\": null, \"documents\": [";
+    for (size_t i = page.begin; i < page.end; ++i) {
+        if (i > page.begin) out += ',';
+        appendJson(out, page.docs[i], projection);
     }
-    return params;
+    return out + "]}";
 }
 
+string toJsonArray(const vector<DocumentView>& docs, const Projection& projection) {
+    string out = "[";
+    for (size_t i = 0; i < docs.size(); ++i) {
+        if (i) out += ',';
+        appendJson(out, docs[i], projection);
+    }
+    return out + "]";
+}
+
+// Aggregate endpoints: count (of non-null numeric values), sum, min, max
+// and avg. Results stay integers as long as the field holds no doubles,
+// except for an int sum past int64, which is given as a double; min, max
+// and avg of an empty field are null.
+json aggregateJson(const Collection::Stats& stats, const string& op) {
+    const IntAggregate& i = stats.ints;
+    const DoubleAggregate& d = stats.doubles;
+    if (op == "count") return stats.count();
+    if (op == "sum") {
+        if (d.count == 0 && i.sumFits()) return int64_t(i.sum);
+        return double(i.sum) + d.total();
+    }
+    if (stats.count() == 0) return nullptr;
+    if (op == "avg") return (double(i.sum) + d.total()) / stats.count();
+    if (d.count == 0) return op == "min" ? i.min : i.max;
+    if (i.count == 0) return op == "min" ? d.min : d.max;
+    return op == "min" ? min(double(i.min), d.min) : max(double(i.max), d.max);
+}
+
+// HTTP helpers
 vector<string> split(const string& s, char delim) {
     vector<string> tokens;
     istringstream ss(s);
@@ -149,169 +855,859 @@ vector<string> split(const string& s, char delim) {
     return tokens;
 }
 
-Document parseJson(const string& body) {
-    Document doc;
-    auto j = json::parse(body);
-    for (auto it = j.begin(); it != j.end(); ++it) {
-        doc[it.key()] = it.value();
+// fields=a,b,c or exclude=a,b,c; names never seen as keys cannot match.
+Projection parseProjection(const QueryParams& params) {
+    Projection projection;
+    string names;
+    if (params.count("fields")) {
+        projection.include = true;
+        projection.ids.push_back(FieldDictionary::kIdField);
+        names = params["fields"];
+    } else if (params.count("exclude")) {
+        names = params["exclude"];
+    }
+    for (auto& name : split(names, ','))
+        if (auto id = fieldNames().find(name)) projection.ids.push_back(*id);
+    sort(projection.ids.begin(), projection.ids.end());
+    projection.ids.erase(unique(projection.ids.begin(), projection.ids.end()), projection.ids.end());
+    return projection;
+}
+
+// A value given in a query string: a JSON literal (30, true, "30") if it
+// parses as one, otherwise the raw text as a string. The value lives in the
+// returned one-element array.
+Document parseQueryValue(const string& raw) {
+    DocumentBuilder builder;
+    try {
+        JsonReader(raw).readValue(builder, 0);
+    } catch (runtime_error&) {
+        builder = DocumentBuilder();
+        builder.addString(0, raw);
     }
-    return doc;
+    return builder.build();
 }
 
-void sendHttpResponse(int clientSocket, int statusCode, const string& body) {
-    string statusText = (statusCode == 200) ? "OK" : "Error";
-    ostringstream oss;
-    oss << "HTTP/1.1 " << statusCode << " " << statusText << "\r\n"
-        << "Content-Type: application/json\r\n"
-        << "Content-Length: " << body.size() << "\r\n"
-        << "Connection: close\r\n\r\n" << body;
-    string response = oss.str();
-    send(clientSocket, response.c_str(), response.size(), 0);
+// The zero _id is a placeholder: Collection::insert overwrites it in the
+// stored copy instead of re-encoding the document. Imports keep theirs.
+Document parseJson(string_view body, bool keepId = false) {
+    DocumentBuilder builder;
+    JsonReader(body).readObject(builder);
+    if (!keepId) builder.addInt(FieldDictionary::kIdField, 0);
+    return builder.build();
+}
+
+// Response heads are assembled from preformatted pieces: the status line
+// and Content-Type of a JSON 200 and both Connection trailers are built
+// once, leaving only the length to format per response.
+const string kJsonOkHead = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n";
+const string kKeepAliveTail = "Connection: keep-alive\r\n\r\n";
+const string kCloseTail = "Connection: close\r\n\r\n";
+
+// Bodies at least this long are handed to the connection rather than
+// copied in behind their head.
+const size_t kCopyLimit = 16 * 1024;
+
+void appendStatusLine(string& out, int statusCode, const string& contentType = "application/json") {
+    if (statusCode == 200 && contentType == "application/json") {
+        out += kJsonOkHead;
+        return;
+    }
+    out += "HTTP/1.1 ";
+    out += to_string(statusCode);
+    out += statusCode == 200 ? " OK\r\n" : " Error\r\n";
+    out += "Content-Type: " + contentType + "\r\n";
+}
+
+void sendHttpResponse(Connection& conn, int statusCode, string body, bool keepAlive) {
+    appendStatusLine(conn.out, statusCode);
+    char length[24];
+    auto end = to_chars(length, length + sizeof(length), body.size()).ptr;
+    conn.out += "Content-Length: ";
+    conn.out.append(length, end);
+    conn.out += "\r\n";
+    conn.out += keepAlive ? kKeepAliveTail : kCloseTail;
+    if (body.size() >= kCopyLimit) conn.enqueue(move(body));
+    else conn.out += body;
+    if (!keepAlive) conn.closeAfterWrite = true;
+}
+
+// Starts a response whose body is produced while it is written, so only
+// one piece is ever buffered. HTTP/1.1 gets chunked transfer encoding;
+// HTTP/1.0 has no chunks, so the body runs until the connection closes.
+void sendHttpStream(Connection& conn, int statusCode, BodyStream body, bool keepAlive, bool chunked,
+                    const string& contentType) {
+    appendStatusLine(conn.out, statusCode, contentType);
+    if (!chunked) keepAlive = false;
+    if (chunked) conn.out += "Transfer-Encoding: chunked\r\n";
+    conn.out += keepAlive ? kKeepAliveTail : kCloseTail;
+    if (!keepAlive) conn.closeAfterWrite = true;
+    if (!chunked) {
+        conn.stream = move(body);
+        return;
+    }
+    // Each piece is produced straight into out behind a fixed-width size
+    // line (leading zeros are allowed in chunk sizes) that is filled in
+    // afterwards, so pieces are not copied to be framed.
+    conn.stream = [body = move(body)](string& out) mutable {
+        static const char hex[] = "0123456789abcdef";
+        const size_t kSizeDigits = 8;
+        size_t head = out.size();
+        out.append(kSizeDigits, '0');
+        out += "\r\n";
+        bool more = body(out);
+        size_t size = out.size() - head - kSizeDigits - 2;
+        if (size == 0) out.resize(head);
+        else {
+            for (size_t i = 0; i < kSizeDigits; ++i) out[head + kSizeDigits - 1 - i] = hex[(size >> (4 * i)) & 15];
+            out += "\r\n";
+        }
+        if (!more) out += "0\r\n\r\n";
+        return more;
+    };
 }
 
 // Shared DB
 System db;
-mutex dbMutex;
-
-// Main HTTP request handler
-void handleConnection(int clientSocket) {
-    const int BUF_SIZE = 8192;
-    char buffer[BUF_SIZE] = {};
-    int received = recv(clientSocket, buffer, BUF_SIZE - 1, 0);
-    if (received <= 0) {
-        close(clientSocket);
-        return;
+CursorTable cursors;
+
+// === Routes ===
+// Everything a route handler gets and fills in. A handler that sets stream
+// leaves response empty; the body comes from the stream instead, of the
+// given contentType. Errors are thrown and answered with a 500, or with a
+// 400 if they are a BadRequest.
+struct RequestContext {
+    const HttpRequest& request;
+    const RouteParams& params;
+    string_view body;
+    string& response;
+    BodyStream& stream;
+    string& contentType;
+
+    const QueryParams& query() const { return request.params; }
+    string user() const { return string(params["user"]); }
+    string col() const { return string(params["col"]); }
+};
+
+using RouteHandler = void (*)(RequestContext&);
+
+struct BadRequest : runtime_error {
+    using runtime_error::runtime_error;
+};
+
+// A non-negative integer query parameter, fallback if absent. A value past
+// size_t saturates: a count that large is as good as unbounded.
+size_t queryCount(const QueryParams& query, const char* name, size_t fallback) {
+    if (!query.count(name)) return fallback;
+    string text = query[name];
+    size_t value = 0;
+    auto [end, ec] = from_chars(text.data(), text.data() + text.size(), value);
+    if (text.empty() || end != text.data() + text.size() || (ec != errc() && ec != errc::result_out_of_range))
+        throw BadRequest(string("Invalid ") + name);
+    return ec == errc() ? value : SIZE_MAX;
+}
+
+void createUser(RequestContext& c) {
+    db.createUser(c.user());
+    c.response = R"({"status": "User created"})";
+}
+
+void createCollection(RequestContext& c) {
+    string user = c.user(), col = c.col();
+    db.createUser(user);
+    db.createCollection(user, col);
+    c.response = R"({"status": "Collection created"})";
+}
+
+void insertDocument(RequestContext& c) {
+    string user = c.user(), col = c.col();
+    Document doc = parseJson(c.body);
+    db.createUser(user);
+    db.createCollection(user, col);
+    db.insertDocument(user, col, doc);
+    c.response = R"({"status": "Document inserted"})";
+}
+
+void createIndex(RequestContext& c) {
+    auto& query = c.query();
+    string field = query["field"];
+    string type = query.count("type") ? query["type"] : "hash";
+    if (field.empty()) throw runtime_error("Missing field");
+    IndexSpec spec{IndexKind::Hash, field};
+    if (type == "hash") spec.kind = IndexKind::Hash;
+    else if (type == "btree") spec.kind = IndexKind::BTree;
+    else if (type == "distinct") spec.kind = IndexKind::Distinct;
+    else if (type == "hll") {
+        // Standard error of the estimate, 1% unless given; no smaller than
+        // the largest sketch allows.
+        double error = 0.01;
+        if (query.count("error")) {
+            string text = query["error"];
+            char* end = nullptr;
+            error = strtod(text.c_str(), &end);
+            if (text.empty() || *end || !(error > 0)) throw BadRequest("Invalid error");
+        }
+        double smallest = HyperLogLog::standardError(HyperLogLog::kMaxPrecision);
+        if (error < smallest) throw BadRequest("error must be at least " + to_string(smallest));
+        spec = {IndexKind::Sketch, field, HyperLogLog::precisionFor(error)};
+    }
+    else throw runtime_error("Unknown index type");
+    db.createIndex(c.user(), c.col(), spec);
+    c.response = R"({"status": "Index created"})";
+}
+
+void createColumn(RequestContext& c) {
+    string field = c.query()["field"];
+    if (field.empty()) throw runtime_error("Missing field");
+    db.createIndex(c.user(), c.col(), {IndexKind::Column, field});
+    c.response = R"({"status": "Column created"})";
+}
+
+// Paging: after=<_id> starts past that document (row _id), skip=N skips
+// further, limit=N caps the page. cursor=new opens a server-side cursor
+// returning limit-sized pages.
+void getDocuments(RequestContext& c) {
+    auto& query = c.query();
+    auto docs = db.getDocuments(c.user(), c.col());
+    size_t begin = min(docs.size(), queryCount(query, "after", 0));
+    begin += min(docs.size() - begin, queryCount(query, "skip", 0));
+    if (query.count("cursor")) {
+        size_t pageSize = queryCount(query, "limit", 100);
+        string id = cursors.open(docs, begin, pageSize);
+        c.response = toJsonPage(cursors.next(id), id, parseProjection(query));
+    } else {
+        size_t end = begin + min(docs.size() - begin, queryCount(query, "limit", SIZE_MAX));
+        c.stream = streamJsonArray(docs, begin, end, parseProjection(query));
     }
-    
+}
+
+// NDJSON of the whole collection, or from after=<_id> on to resume;
+// compress=gzip|zstd compresses it.
+void exportDocuments(RequestContext& c) {
+    auto& query = c.query();
+    auto docs = db.getDocuments(c.user(), c.col());
+    size_t begin = min(docs.size(), queryCount(query, "after", 0));
+    Compression compression = compressionNamed(query["compress"]);
+    c.contentType = compression == Compression::Gzip ? "application/gzip"
+                  : compression == Compression::Zstd ? "application/zstd" : "application/x-ndjson";
+    c.stream = streamNdjson(docs, begin, makeCodec(compression, true));
+}
 
-    string request(buffer);
-    istringstream ss(request);
-    string method, url, version;
-    ss >> method >> url >> version;
+void nextPage(RequestContext& c) {
+    string id(c.params["id"]);
+    c.response = toJsonPage(cursors.next(id), id, parseProjection(c.query()));
+}
 
-    string path = url;
-    string query;
-    if (auto q = url.find('?'); q != string::npos) {
-        path = url.substr(0, q);
-        query = url.substr(q + 1);
+void findDocuments(RequestContext& c) {
+    auto& query = c.query();
+    Document value = parseQueryValue(query["value"]);
+    auto found = db.findDocuments(c.user(), c.col(), query["field"], value.view().value(0));
+    c.response = toJsonArray(found, parseProjection(query));
+}
+
+// gt=, gte=, lt= and lte= bounds; the values live in bounds while the
+// range is used.
+ValueRange parseRange(const QueryParams& query, vector<Document>& bounds) {
+    bounds.reserve(4);
+    ValueRange range;
+    for (const char* name : {"gt", "gte", "lt", "lte"}) {
+        if (!query.count(name)) continue;
+        bounds.push_back(parseQueryValue(query[name]));
+        ValueRange::Bound bound{bounds.back().view().value(0), name[2] == 'e'};
+        if (name[0] == 'g') range.lower = bound;
+        else range.upper = bound;
     }
+    return range;
+}
 
-    auto segments = split(path, '/');
-    auto queryParams = parseQuery(query);
+void rangeDocuments(RequestContext& c) {
+    auto& query = c.query();
+    vector<Document> bounds;
+    ValueRange range = parseRange(query, bounds);
+    bool descending = query["order"] == "desc";
+    size_t limit = queryCount(query, "limit", SIZE_MAX);
+    auto found = db.rangeDocuments(c.user(), c.col(), query["field"], range, descending, limit);
+    c.response = toJsonArray(found, parseProjection(query));
+}
+
+void countRange(RequestContext& c) {
+    vector<Document> bounds;
+    ValueRange range = parseRange(c.query(), bounds);
+    c.response = "{\"count\": " + to_string(db.countRange(c.user(), c.col(), c.query()["field"], range)) + "}";
+}
+
+// The aggregate is named by the last path segment.
+void aggregate(RequestContext& c) {
+    const auto& segments = c.request.segments;
+    string op(segments[segments.size() - 1]);
+    json j = json::object();
+    j[op] = aggregateJson(db.fieldStats(c.user(), c.col(), c.query()["field"]), op);
+    c.response = j.dump();
+}
 
-    string response;
-    int code = 200;
+// Without field= this counts documents rather than values.
+void count(RequestContext& c) {
+    if (c.query().count("field")) return aggregate(c);
+    c.response = "{\"count\": " + to_string(db.countDocuments(c.user(), c.col())) + "}";
+}
 
+void distinctValues(RequestContext& c) {
+    c.response = "[";
+    for (auto& val : db.distinctValues(c.user(), c.col(), c.query()["field"])) {
+        if (c.response.size() > 1) c.response += ',';
+        appendJson(c.response, val);
+    }
+    c.response += ']';
+}
+
+// approx=true answers from the field's sketch; without one the count is
+// exact, and "exact" says which it was.
+void distinctCount(RequestContext& c) {
+    string user = c.user(), col = c.col(), field = c.query()["field"];
+    if (c.query()["approx"] != "true") {
+        c.response = "{\"count\": " + to_string(db.distinctCount(user, col, field)) + "}";
+        return;
+    }
+    optional<uint64_t> estimate = db.approxDistinctCount(user, col, field);
+    uint64_t count = estimate ? *estimate : db.distinctCount(user, col, field);
+    c.response = "{\"count\": " + to_string(count) + ", \"exact\": " + (estimate ? "false" : "true") + "}";
+}
+
+void listCollections(RequestContext& c) {
+    json j = json::array();
+    for (auto& val : db.listCollections(c.user())) j.push_back(val);
+    c.response = j.dump();
+}
+
+Router<RouteHandler> makeRoutes() {
+    const string col = "/user/:user/collection/:col";
+    Router<RouteHandler> routes;
+    routes.add("POST", "/user/:user", createUser);
+    routes.add("POST", col, createCollection);
+    routes.add("POST", col + "/document", insertDocument);
+    routes.add("POST", col + "/index", createIndex);
+    routes.add("POST", col + "/column", createColumn);
+    routes.add("GET", col + "/documents", getDocuments);
+    routes.add("GET", col + "/export", exportDocuments);
+    routes.add("GET", "/cursor/:id", nextPage);
+    routes.add("GET", col + "/find", findDocuments);
+    routes.add("GET", col + "/range", rangeDocuments);
+    routes.add("GET", col + "/count_range", countRange);
+    routes.add("GET", col + "/count", count);
+    for (const char* op : {"sum", "min", "max", "avg"}) routes.add("GET", col + "/" + op, aggregate);
+    routes.add("GET", col + "/distinct", distinctValues);
+    routes.add("GET", col + "/distinct_count", distinctCount);
+    routes.add("GET", "/user/:user/collections", listCollections);
+    return routes;
+}
+
+const Router<RouteHandler> routes = makeRoutes();
+
+// Dispatches one complete request; returns the status code.
+int handleRequest(const HttpRequest& request, string_view body, string& response, BodyStream& stream,
+                  string& contentType) {
+    RouteParams params;
+    auto match = routes.match(request.method, request.segments, params);
+    if (!match.handler) {
+        response = match.pathFound ? R"({"error": "Method not allowed"})" : R"({"error": "Unknown endpoint"})";
+        return match.pathFound ? 405 : 404;
+    }
+
+    RequestContext context{request, params, body, response, stream, contentType};
     try {
-        if (method == "POST") {
-            if (segments.size() == 3 && segments[1] == "user") {
-                string user = segments[2];
-                lock_guard<mutex> lock(dbMutex);
-                db.createUser(user);
-                response = R"({"status": "User created"})";
-            }
-            else if (segments.size() == 5 && segments[1] == "user" && segments[3] == "collection") {
-                string user = segments[2], col = segments[4];
-                lock_guard<mutex> lock(dbMutex);
-                db.createUser(user);
-                db.createCollection(user, col);
-                response = R"({"status": "Collection created"})";
+        (*match.handler)(context);
+    } catch (BadRequest& e) {
+        response = "{\"error\": \"" + string(e.what()) + "\"}";
+        return 400;
+    } catch (exception& e) {
+        response = "{\"error\": \"" + string(e.what()) + "\"}";
+        return 500;
+    }
+    return 200;
+}
+
+// === Bulk insert ===
+// POST .../documents:bulk takes a JSON array of documents or NDJSON (one
+// document per line) of any length. The body is consumed as it arrives
+// instead of being buffered whole: complete records are parsed and inserted
+// kBulkBatch at a time under one write lock, and only the unfinished tail
+// of the last record is kept. Records before a malformed one stay inserted.
+const size_t kBulkBatch = 4096;
+const size_t kMaxBulkRecord = 64 * 1024 * 1024;
+
+class BulkLoader {
+public:
+    // keepIds: an import, whose documents keep their _id.
+    BulkLoader(string user, string col, bool keepIds)
+        : user(move(user)), col(move(col)), keepIds(keepIds) {
+        db.createCollection(this->user, this->col);
+    }
+
+    // Takes the next body bytes; throws on a malformed record.
+    void feed(string_view bytes) {
+        pending.append(bytes.data(), bytes.size());
+        scan(false);
+        flush();
+    }
+
+    // Called once the body is complete.
+    void finish() {
+        scan(true);
+        flush();
+    }
+
+    // Inserts the records parsed so far.
+    void flush() {
+        if (batch.empty()) return;
+        if (keepIds) {
+            inserted += db.importDocuments(user, col, batch);
+        } else {
+            db.insertDocuments(user, col, batch);
+            inserted += batch.size();
+        }
+        batch.clear();
+    }
+
+    size_t count() const { return inserted; }
+
+private:
+    enum class Format { Unknown, Array, Lines };
+
+    static bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+
+    // Parses pending[from, to); returns false if it is only whitespace.
+    bool record(size_t from, size_t to) {
+        while (from < to && isSpace(pending[from])) ++from;
+        while (to > from && isSpace(pending[to - 1])) --to;
+        if (from == to) return false;
+        ++records;
+        try {
+            batch.push_back(parseJson(string_view(pending).substr(from, to - from), keepIds));
+        } catch (exception& e) {
+            throw runtime_error("Record " + to_string(records) + ": " + e.what());
+        }
+        if (batch.size() >= kBulkBatch) flush();
+        return true;
+    }
+
+    void scan(bool end) {
+        if (format == Format::Unknown) {
+            while (start < pending.size() && isSpace(pending[start])) ++start;
+            if (start == pending.size()) return;
+            format = pending[start] == '[' ? Format::Array : Format::Lines;
+            if (format == Format::Array) {
+                scanned = ++start;
+                depth = 1;
             }
-            else if (segments.size() == 6 && segments[5] == "document") {
-                string user = segments[2], col = segments[4];
-
-                string body = request.substr(request.find("\r\n\r\n") + 4);
-                size_t contentLength = 0;
-                if (auto pos = request.find("Content-Length:"); pos != string::npos) {
-                    contentLength = stoi(request.substr(pos + 15));
-                    while (body.size() < contentLength) {
-                        char more[4096];
-                        int got = recv(clientSocket, more, sizeof(more), 0);
-                        if (got <= 0) break;
-                        body.append(more, got);
-                    }
-                }
+        }
+        if (format == Format::Lines) scanLines(end);
+        else scanArray(end);
 
-                Document doc = parseJson(body);
-                lock_guard<mutex> lock(dbMutex);
-                db.createUser(user);
-                db.createCollection(user, col);
-                db.insertDocument(user, col, doc);
-                response = R"({"status": "Document inserted"})";
-            } else {
-                code = 404;
-                response = R"({"error": "Unknown endpoint"})";
+        pending.erase(0, start);
+        scanned -= start;
+        start = 0;
+        if (pending.size() > kMaxBulkRecord) throw runtime_error("Record " + to_string(records + 1) + ": too large");
+    }
+
+    void scanLines(bool end) {
+        for (size_t nl; (nl = pending.find('\n', scanned)) != string::npos; start = scanned = nl + 1)
+            record(start, nl);
+        scanned = pending.size();
+        if (end) {
+            record(start, pending.size());
+            start = pending.size();
+        }
+    }
+
+    // Tracks strings and nesting only to find the commas and the bracket
+    // that end top-level elements; the elements themselves are validated by
+    // the JSON reader.
+    void scanArray(bool end) {
+        for (; scanned < pending.size(); ++scanned) {
+            if (inString) {
+                if (escaped) {
+                    escaped = false;
+                    continue;
+                }
+                scanned += json_detail::plainPrefix(pending.data() + scanned, pending.size() - scanned);
+                if (scanned == pending.size()) break;
+                if (pending[scanned] == '\\') escaped = true;
+                else if (pending[scanned] == '"') inString = false;
+                continue;
             }
-        } else if (method == "GET") {
-            if (segments.size() == 6 && segments[5] == "documents") {
-                string user = segments[2], col = segments[4];
-                lock_guard<mutex> lock(dbMutex);
-                response = toJsonArray(db.getDocuments(user, col));
+            char c = pending[scanned];
+            if (depth == 0) {
+                if (!isSpace(c)) throw runtime_error("Unexpected data after array");
+                continue;
             }
-            else if (segments.size() == 6 && segments[5] == "count") {
-                string user = segments[2], col = segments[4];
-                lock_guard<mutex> lock(dbMutex);
-                response = "{\"count\": " + to_string(db.countDocuments(user, col)) + "}";
+            switch (c) {
+                case '"': inString = true; break;
+                case '{': case '[': ++depth; break;
+                case '}': case ']':
+                    if (--depth > 0) break;
+                    if (c != ']') throw runtime_error("Malformed JSON array");
+                    if (!record(start, scanned) && records > 0) throw runtime_error("Malformed JSON array");
+                    start = scanned + 1;
+                    break;
+                case ',':
+                    if (depth > 1) break;
+                    if (!record(start, scanned)) throw runtime_error("Malformed JSON array");
+                    start = scanned + 1;
+                    break;
             }
-            else if (segments.size() == 6 && segments[5] == "sum") {
-                string user = segments[2], col = segments[4];
-                string field = queryParams["field"];
-                lock_guard<mutex> lock(dbMutex);
-                response = "{\"sum\": " + to_string(db.sumField(user, col, field)) + "}";
+        }
+        start = min(start, pending.size());
+        if (end && depth > 0) throw runtime_error("Unterminated JSON array");
+    }
+
+    string user, col;
+    bool keepIds;
+    Format format = Format::Unknown;
+    string pending;        // body bytes from the start of the current record
+    size_t start = 0;      // where the current record begins in pending
+    size_t scanned = 0;    // how far pending has been scanned
+    int depth = 0;         // array nesting, the outer array included
+    bool inString = false, escaped = false;
+    size_t records = 0;    // records parsed, for error messages
+    size_t inserted = 0;
+    vector<Document> batch;
+};
+
+// Framing of a request body read while it arrives: a Content-Length, or
+// chunked transfer encoding.
+class BodyReader {
+public:
+    BodyReader(size_t length, bool chunked)
+        : left(length), chunked(chunked), state(chunked ? State::Size : State::Data) {}
+
+    // Passes the body bytes in `in` to fn and removes them (with any chunk
+    // framing); returns true once the whole body has been read. Throws on
+    // malformed chunk framing.
+    template <typename Fn>
+    bool read(string& in, Fn&& fn) {
+        size_t pos = 0;
+        bool done;
+        try {
+            done = step(in, pos, fn);
+        } catch (...) {
+            in.erase(0, pos);
+            throw;
+        }
+        in.erase(0, pos);
+        return done;
+    }
+
+private:
+    enum class State { Size, Data, DataEnd, Trailer };
+
+    template <typename Fn>
+    bool step(const string& in, size_t& pos, Fn& fn) {
+        while (true) {
+            if (state == State::Data) {
+                size_t n = min(left, in.size() - pos);
+                if (n > 0) fn(string_view(in).substr(pos, n));
+                pos += n;
+                left -= n;
+                if (left > 0) return false;
+                if (!chunked) return true;
+                state = State::DataEnd;
             }
-            else if (segments.size() == 6 && segments[5] == "distinct") {
-                string user = segments[2], col = segments[4];
-                string field = queryParams["field"];
-                lock_guard<mutex> lock(dbMutex);
-                json j = json::array();
-                for (auto& val : db.distinctValues(user, col, field)) j.push_back(val);
-                response = j.dump();
+            size_t eol = in.find("\r\n", pos);
+            if (eol == string::npos) {
+                if (in.size() - pos > 4096) throw runtime_error("Malformed chunk");
+                return false;
             }
-            else if (segments.size() == 4 && segments[3] == "collections") {
-                string user = segments[2];
-                lock_guard<mutex> lock(dbMutex);
-                json j = json::array();
-                for (auto& val : db.listCollections(user)) j.push_back(val);
-                response = j.dump();
+            string_view line(in.data() + pos, eol - pos);
+            pos = eol + 2;
+            if (state == State::Size) {
+                line = line.substr(0, line.find(';'));
+                auto [end, ec] = from_chars(line.data(), line.data() + line.size(), left, 16);
+                if (ec != errc() || end != line.data() + line.size()) throw runtime_error("Malformed chunk");
+                state = left > 0 ? State::Data : State::Trailer;
+            } else if (state == State::DataEnd) {
+                if (!line.empty()) throw runtime_error("Malformed chunk");
+                state = State::Size;
+            } else if (line.empty()) {
+                return true;
             }
-            else {
-                code = 404;
-                response = R"({"error": "Unknown endpoint"})";
+        }
+    }
+
+    size_t left;
+    bool chunked;
+    State state;
+};
+
+// A documents:bulk or import request, whose body is read as it arrives.
+// Imports take NDJSON as written by export, compressed if compress= says
+// so, and keep each document's _id.
+struct BulkRequest {
+    string user, col;
+    bool import = false;
+    string compress;
+};
+
+// Routes whose bodies are read as they arrive; the value marks an import.
+Router<bool> makeUploadRoutes() {
+    Router<bool> routes;
+    routes.add("POST", "/user/:user/collection/:col/documents:bulk", false);
+    routes.add("POST", "/user/:user/collection/:col/import", true);
+    return routes;
+}
+
+const Router<bool> uploadRoutes = makeUploadRoutes();
+
+optional<BulkRequest> bulkTarget(const HttpRequest& request) {
+    RouteParams params;
+    auto match = uploadRoutes.match(request.method, request.segments, params);
+    if (!match.handler) return nullopt;
+    return BulkRequest{string(params["user"]), string(params["col"]), *match.handler, request.params["compress"]};
+}
+
+// Connection::upload for a documents:bulk or import request: loads the
+// body as it arrives and responds with the number of documents inserted
+// once it has all been read. After a bad record the rest of the body is
+// discarded.
+class BulkUpload {
+public:
+    BulkUpload(const HttpRequest& request, BulkRequest target, bool keepAlive)
+        : reader(request.contentLength, request.chunked),
+          target(move(target)), keepAlive(keepAlive) {
+        try {
+            codec = makeCodec(compressionNamed(this->target.compress), false);
+        } catch (exception& e) {
+            fail(e);
+        }
+    }
+
+    bool operator()(Connection& conn) {
+        bool done;
+        try {
+            done = reader.read(conn.in, [&](string_view bytes) { take(bytes); });
+        } catch (exception& e) {
+            // Broken framing: the rest of the stream cannot be trusted.
+            fail(e);
+            keepAlive = false;
+            done = true;
+        }
+        if (!done) return true;
+        if (error.empty()) take({}, true);
+
+        size_t inserted = loader ? loader->count() : 0;
+        if (error.empty()) sendHttpResponse(conn, 200, "{\"inserted\": " + to_string(inserted) + "}", keepAlive);
+        else sendHttpResponse(conn, 500, "{\"error\": \"" + error + "\", \"inserted\": " + to_string(inserted) + "}", keepAlive);
+        return false;
+    }
+
+private:
+    void take(string_view bytes, bool end = false) {
+        if (!error.empty()) return;
+        try {
+            if (!loader) loader = make_shared<BulkLoader>(target.user, target.col, target.import);
+            if (codec) {
+                decoded.clear();
+                if (end) codec->finish(decoded);
+                else codec->write(bytes, decoded);
+                bytes = decoded;
             }
-        } else {
-            code = 405;
-            response = R"({"error": "Method not allowed"})";
+            if (!bytes.empty()) loader->feed(bytes);
+            if (end) loader->finish();
+        } catch (exception& e) {
+            fail(e);
+        }
+    }
+
+    void fail(exception& e) {
+        if (error.empty()) error = e.what();
+        try {
+            if (loader) loader->flush();
+        } catch (exception&) {
         }
-    } catch (exception& e) {
-        code = 500;
-        response = "{\"error\": \"" + string(e.what()) + "\"}";
     }
 
-    sendHttpResponse(clientSocket, code, response);
-    close(clientSocket);
+    BodyReader reader;
+    BulkRequest target;
+    bool keepAlive;
+    shared_ptr<StreamCodec> codec;   // decompresses an import
+    string decoded;
+    shared_ptr<BulkLoader> loader;
+    string error;
+};
+
+// Main HTTP connection handler: runs on a worker whenever new bytes arrive.
+// Answers every complete (possibly pipelined) request in the buffer and
+// returns as soon as the remainder is a partial request.
+void handleConnection(Connection& conn) {
+    while (!conn.closeAfterWrite && !conn.stream) {
+        if (conn.upload) {
+            if (conn.upload(conn)) return;
+            conn.upload = nullptr;
+            continue;
+        }
+
+        auto status = conn.http.parse(conn.in);
+        if (status == HttpParser::Status::Partial) return;
+        if (status == HttpParser::Status::Invalid) {
+            // The stream cannot be resynchronized after a bad head.
+            conn.in.clear();
+            sendHttpResponse(conn, conn.http.errorStatus(), string("{\"error\": \"") + conn.http.error() + "\"}", false);
+            return;
+        }
+
+        // request points into conn.in: everything needed from it is taken
+        // before the buffer is trimmed.
+        const HttpRequest& request = conn.http.request();
+        bool keepAlive = conn.requestsLeft > 1 && request.keepAlive();
+        size_t headBytes = request.headBytes;
+        if (auto target = bulkTarget(request)) {
+            --conn.requestsLeft;
+            if (http_detail::equalsIgnoreCase(request.header("Expect"), "100-continue"))
+                conn.out += "HTTP/1.1 100 Continue\r\n\r\n";
+            conn.upload = BulkUpload(request, move(*target), keepAlive);
+            conn.in.erase(0, headBytes);
+            conn.http.reset();
+            continue;
+        }
+        if (request.chunked) {
+            conn.in.clear();
+            sendHttpResponse(conn, 411, R"({"error": "Chunked bodies are only accepted by bulk endpoints"})", false);
+            return;
+        }
+        size_t contentLength = request.contentLength;
+        if (conn.in.size() - headBytes < contentLength) return;
+
+        // The body is parsed in place; it is dropped from the buffer after.
+        string_view body(conn.in.data() + headBytes, contentLength);
+        string response, contentType = "application/json";
+        BodyStream stream;
+        int code = handleRequest(request, body, response, stream, contentType);
+        --conn.requestsLeft;
+        bool chunked = !request.http10();
+        conn.in.erase(0, headBytes + contentLength);
+        conn.http.reset();
+        if (stream) sendHttpStream(conn, code, move(stream), keepAlive, chunked, contentType);
+        else sendHttpResponse(conn, code, move(response), keepAlive);
+    }
 }
 
-int main() {
+// === Checkpoints ===
+// Checkpoints the database every `interval` on a thread of its own,
+// skipping intervals in which nothing was logged. The log must outlive
+// the checkpointer; destroying it stops the thread and waits for it.
+class Checkpointer {
+public:
+    Checkpointer(WriteAheadLog& wal, string path, chrono::seconds interval)
+        : wal(wal), path(move(path)), interval(interval), worker([this] { run(); }) {}
+
+    ~Checkpointer() {
+        {
+            lock_guard<mutex> lock(mtx);
+            stopping = true;
+        }
+        cv.notify_all();
+        worker.join();
+    }
+
+private:
+    void run() {
+        uint64_t covered = wal.appended();
+        unique_lock<mutex> lock(mtx);
+        while (!cv.wait_for(lock, interval, [this] { return stopping; })) {
+            uint64_t appended = wal.appended();
+            if (appended == covered) continue;
+            lock.unlock();
+            try {
+                db.checkpoint(path);
+                covered = appended;
+            } catch (exception& e) {
+                cerr << "Checkpoint failed: " << e.what() << "\n";
+            }
+            lock.lock();
+        }
+    }
+
+    WriteAheadLog& wal;
+    string path;
+    chrono::seconds interval;
+    mutex mtx;
+    condition_variable cv;
+    bool stopping = false;
+    thread worker;   // declared last so it starts after the state it uses
+};
+
+int main(int argc, char** argv) {
+    int port = 8080;
+    EventLoop::Options options;
+    options.workers = max(1u, thread::hardware_concurrency());
+
+    string dataDir;
+    WriteAheadLog::Options walOptions;
+    chrono::seconds checkpointInterval(300);
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string flag = argv[i], arg = argv[i + 1];
+        size_t value = strtoull(arg.c_str(), nullptr, 10);
+        if (flag == "--port") port = value;
+        else if (flag == "--workers") options.workers = max<size_t>(1, value);
+        else if (flag == "--max-connections") options.maxConnections = value;
+        else if (flag == "--max-requests") options.maxRequestsPerConnection = max<size_t>(1, value);
+        else if (flag == "--idle-timeout") options.idleTimeout = chrono::seconds(value);
+        else if (flag == "--data-dir") dataDir = arg;
+        else if (flag == "--durability" && arg == "sync") walOptions.durability = Durability::Sync;
+        else if (flag == "--durability" && arg == "batch") walOptions.durability = Durability::Batch;
+        else if (flag == "--durability" && arg == "os") walOptions.durability = Durability::Os;
+        else if (flag == "--batch-ms") walOptions.batchInterval = chrono::milliseconds(max<size_t>(1, value));
+        else if (flag == "--checkpoint-interval") checkpointInterval = chrono::seconds(value);
+        else if (flag == "--cursor-timeout") cursors.timeout = chrono::seconds(max<size_t>(1, value));
+        else {
+            cerr << "Unknown option " << flag << " " << arg << "\n"
+                 << "Usage: server [--port N] [--workers N] [--max-connections N]\n"
+                 << "              [--max-requests N] [--idle-timeout SECONDS]\n"
+                 << "              [--data-dir DIR] [--durability sync|batch|os] [--batch-ms N]\n"
+                 << "              [--checkpoint-interval SECONDS] [--cursor-timeout SECONDS]\n";
+            return 1;
+        }
+    }
+
+    // Without a data directory everything stays in memory, as before.
+    unique_ptr<WriteAheadLog> wal;
+    string checkpointPath = dataDir + "/checkpoint.db";
+    if (!dataDir.empty()) {
+        mkdir(dataDir.c_str(), 0755);
+        walOptions.dir = dataDir;
+        try {
+            wal = make_unique<WriteAheadLog>(walOptions);
+            db.recover(*wal, db.loadCheckpoint(checkpointPath));
+        } catch (exception& e) {
+            cerr << "Recovery failed: " << e.what() << "\n";
+            return 1;
+        }
+    }
+
     int server = socket(AF_INET, SOCK_STREAM, 0);
     int opt = 1;
     setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
 
     sockaddr_in addr{};
     addr.sin_family = AF_INET;
-    addr.sin_port = htons(8080);
+    addr.sin_port = htons(port);
     addr.sin_addr.s_addr = INADDR_ANY;
 
-    bind(server, (sockaddr*)&addr, sizeof(addr));
-    listen(server, 10);
+    if (bind(server, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(server, SOMAXCONN) < 0) {
+        perror("bind/listen");
+        return 1;
+    }
+
+    // Started only once the server is up, and declared after the log so it
+    // stops before the log goes away.
+    unique_ptr<Checkpointer> checkpointer;
+    if (wal && checkpointInterval.count() > 0)
+        checkpointer = make_unique<Checkpointer>(*wal, checkpointPath, checkpointInterval);
 
-    cout << "Server running on http://localhost:8080\n";
+    cout << "Server running on http://localhost:" << port
+         << " (" << options.workers << " workers)\n";
 
-    while (true) {
-        sockaddr_in client;
-        socklen_t size = sizeof(client);
-        int clientSocket = accept(server, (sockaddr*)&client, &size);
-        thread(handleConnection, clientSocket).detach();
-    }
+    EventLoop loop(server, options, handleConnection);
+    loop.run();
 
     close(server);
 }
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "http_parser.hpp"
+
+// === Router ===
+// Routes are path patterns such as /user/:user/collection/:col/find, where
+// a :name segment matches any one non-empty segment and binds it. They are
+// compiled into a trie with one level per path segment, so a request is
+// matched in a single walk over its segments: a literal child is tried
+// before the parameter child, backing off to it only if the literal branch
+// leads nowhere. Bound parameters are views into the request.
+
+class RouteParams {
+public:
+    static constexpr size_t kMax = 8;
+
+    // "" if the route has no such parameter.
+    std::string_view operator[](std::string_view name) const {
+        for (size_t i = 0; i < count; ++i)
+            if (names[i] == name) return values[i];
+        return {};
+    }
+
+private:
+    template <typename> friend class Router;
+
+    std::string_view names[kMax], values[kMax];
+    size_t count = 0;
+};
+
+template <typename Handler>
+class Router {
+public:
+    // handler is null when nothing matched; pathFound tells a path served
+    // for other methods only (405) from an unknown one (404).
+    struct Match {
+        const Handler* handler = nullptr;
+        bool pathFound = false;
+    };
+
+    // Throws std::logic_error for a duplicate route or a parameter named
+    // differently from the one another route has in the same position.
+    void add(std::string_view method, std::string_view pattern, Handler handler) {
+        PathSegments segments;
+        segments.assign(pattern);
+        if (segments.size() > PathSegments::kMax) throw std::logic_error("Route too long");
+        uint32_t node = 0;
+        for (size_t i = 0; i < segments.size(); ++i) node = child(node, segments[i]);
+        for (auto& entry : nodes[node].methods)
+            if (entry.first == method) throw std::logic_error("Duplicate route " + std::string(pattern));
+        nodes[node].methods.emplace_back(std::string(method), std::move(handler));
+    }
+
+    Match match(std::string_view method, const PathSegments& segments, RouteParams& params) const {
+        params.count = 0;
+        Match result;
+        if (segments.size() > PathSegments::kMax) return result;
+        const Node* node = find(0, segments, 0, params);
+        if (!node) return result;
+        result.pathFound = true;
+        for (auto& entry : node->methods)
+            if (entry.first == method) result.handler = &entry.second;
+        return result;
+    }
+
+private:
+    struct Node {
+        std::vector<std::pair<std::string, uint32_t>> literals;
+        uint32_t param = 0;   // child for a :name segment; 0 (the root) for none
+        std::string paramName;
+        std::vector<std::pair<std::string, Handler>> methods;
+    };
+
+    uint32_t child(uint32_t node, std::string_view segment) {
+        bool isParam = !segment.empty() && segment[0] == ':';
+        if (isParam) {
+            std::string_view name = segment.substr(1);
+            if (uint32_t existing = nodes[node].param) {
+                if (nodes[existing].paramName != name) throw std::logic_error("Conflicting route parameter " + std::string(name));
+                return existing;
+            }
+            nodes.emplace_back();
+            nodes.back().paramName = std::string(name);
+            nodes[node].param = uint32_t(nodes.size() - 1);
+            return nodes[node].param;
+        }
+        for (auto& [text, next] : nodes[node].literals)
+            if (text == segment) return next;
+        nodes.emplace_back();
+        nodes[node].literals.emplace_back(std::string(segment), uint32_t(nodes.size() - 1));
+        return uint32_t(nodes.size() - 1);
+    }
+
+    const Node* find(uint32_t index, const PathSegments& segments, size_t i, RouteParams& params) const {
+        const Node& node = nodes[index];
+        if (i == segments.size()) return node.methods.empty() ? nullptr : &node;
+        std::string_view segment = segments[i];
+        for (auto& [text, next] : node.literals)
+            if (text == segment)
+                if (const Node* found = find(next, segments, i + 1, params)) return found;
+        if (node.param && !segment.empty() && params.count < RouteParams::kMax) {
+            params.names[params.count] = nodes[node.param].paramName;
+            params.values[params.count++] = segment;
+            if (const Node* found = find(node.param, segments, i + 1, params)) return found;
+            --params.count;
+        }
+        return nullptr;
+    }
+
+    std::vector<Node> nodes{1};
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+
+#include "document.hpp"
+
+// === HyperLogLog ===
+// Fixed-size estimate of a field's distinct-value count: 2^precision
+// one-byte registers, each holding the longest run of leading zeros seen
+// among the hashes routed to it. The relative standard error is about
+// 1.04 / sqrt(2^precision): 1.6% at 12 (4 KB), 0.8% at 14 (16 KB), the
+// cap, which keeps a sketch small next to the indexes it sits with.
+//
+// Single writer; readers may estimate concurrently, hence the relaxed
+// atomic registers.
+class HyperLogLog {
+public:
+    static constexpr uint32_t kMinPrecision = 4;
+    static constexpr uint32_t kMaxPrecision = 14;
+
+    explicit HyperLogLog(uint32_t precision)
+        : precision(precision), registers(new std::atomic<uint8_t>[size_t(1) << precision]) {
+        for (size_t i = 0; i < registerCount(); ++i) registers[i].store(0, std::memory_order_relaxed);
+    }
+
+    static double standardError(uint32_t precision) { return 1.04 / std::sqrt(std::ldexp(1.0, int(precision))); }
+
+    // Smallest precision whose standard error is at most the given one,
+    // within [kMinPrecision, kMaxPrecision].
+    static uint32_t precisionFor(double error) {
+        double registersNeeded = std::pow(1.04 / error, 2);
+        auto p = uint32_t(std::ceil(std::log2(registersNeeded)));
+        return std::min(kMaxPrecision, std::max(kMinPrecision, p));
+    }
+
+    void add(const Value& value, size_t /*row*/) {
+        uint64_t h = mix(ValueHash()(value));
+        size_t index = h >> (64 - precision);
+        uint64_t rest = h << precision;
+        auto rank = uint8_t(rest ? __builtin_clzll(rest) + 1 : 64 - precision + 1);
+        auto& reg = registers[index];
+        if (rank > reg.load(std::memory_order_relaxed)) reg.store(rank, std::memory_order_relaxed);
+    }
+
+    uint64_t estimate() const {
+        double m = double(registerCount());
+        double sum = 0;
+        size_t zeros = 0;
+        for (size_t i = 0; i < registerCount(); ++i) {
+            uint8_t r = registers[i].load(std::memory_order_relaxed);
+            sum += std::ldexp(1.0, -int(r));
+            zeros += r == 0;
+        }
+        double alpha = 0.7213 / (1 + 1.079 / m);
+        double raw = alpha * m * m / sum;
+        // Small cardinalities: linear counting over the empty registers.
+        if (raw <= 2.5 * m && zeros > 0) return uint64_t(std::llround(m * std::log(m / zeros)));
+        return uint64_t(std::llround(raw));
+    }
+
+    uint32_t precisionBits() const { return precision; }
+
+private:
+    size_t registerCount() const { return size_t(1) << precision; }
+
+    // splitmix64 finalizer, so weak hashes (small ints, bools) still spread
+    // over all 64 bits.
+    static uint64_t mix(uint64_t x) {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    const uint32_t precision;
+    std::unique_ptr<std::atomic<uint8_t>[]> registers;
+};
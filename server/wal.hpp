@@ -0,0 +1,286 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "codec.hpp"
+
+// How long an acknowledged write may sit outside stable storage.
+enum class Durability {
+    Sync,    // commit() returns after fdatasync; concurrent commits share one
+    Batch,   // a background thread writes and syncs every batchInterval
+    Os,      // commit() hands the bytes to the kernel but never syncs
+};
+
+// === WriteAheadLog ===
+// Append-only log of opaque records, framed as [u32 length][u32 crc][bytes].
+// append() only copies the record into an in-memory buffer; commit() makes
+// it durable according to the configured mode. Whoever finds no flush in
+// progress becomes the leader and writes out everything buffered so far,
+// so commits that arrive while a sync is running are covered by the next
+// one (group commit).
+//
+// The log is split into numbered segment files (wal.<seq>.log) so that a
+// checkpoint can rotate to a fresh segment and later drop the old ones.
+class WriteAheadLog {
+public:
+    struct Options {
+        std::string dir;
+        Durability durability = Durability::Sync;
+        std::chrono::milliseconds batchInterval{10};
+    };
+
+    explicit WriteAheadLog(Options options) : options(std::move(options)) {}
+
+    ~WriteAheadLog() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        timerCv.notify_all();
+        if (flusher.joinable()) flusher.join();
+        if (fd < 0) return;
+        try {
+            flushTo(appendedLsn, true);
+        } catch (std::exception&) {
+        }
+        close(fd);
+    }
+
+    // Feeds every intact record from segment fromSeq onwards to apply in log
+    // order, then opens the newest segment for appending. A torn tail left
+    // in the newest segment by a crash is cut off; damage in an older,
+    // already rotated segment is an error. Must run before the first append.
+    void replay(uint64_t fromSeq, const std::function<void(std::string_view)>& apply) {
+        std::vector<uint64_t> segments = listSegments();
+        segments.erase(std::remove_if(segments.begin(), segments.end(),
+                                      [&](uint64_t s) { return s < fromSeq; }),
+                       segments.end());
+        if (segments.empty()) segments.push_back(std::max<uint64_t>(fromSeq, 1));
+
+        uint64_t total = 0;
+        for (size_t i = 0; i < segments.size(); ++i) {
+            bool last = i + 1 == segments.size();
+            int segFd = open(segmentPath(segments[i]).c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+            if (segFd < 0) throw std::runtime_error("Cannot open " + segmentPath(segments[i]));
+
+            uint64_t good = replaySegment(segFd, apply);
+            if (!last) {
+                close(segFd);
+                if (good != static_cast<uint64_t>(fileSize(segments[i])))
+                    throw std::runtime_error("Corrupt WAL segment " + segmentPath(segments[i]));
+            } else {
+                if (ftruncate(segFd, good) != 0 || lseek(segFd, good, SEEK_SET) < 0)
+                    throw std::runtime_error("Cannot truncate " + segmentPath(segments[i]));
+                fd = segFd;
+                segment = segments[i];
+            }
+            total += good;
+        }
+        appendedLsn = flushedLsn = total;
+
+        if (options.durability == Durability::Batch)
+            flusher = std::thread([this] { runFlusher(); });
+    }
+
+    // Syncs the current segment and switches appends to a new one. Every
+    // record appended before the call lives in a segment older than the
+    // returned sequence number.
+    uint64_t rotate() {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (flushing) flushedCv.wait(lock);
+        if (failed) throw std::runtime_error("WAL write failed");
+
+        flushing = true;
+        std::string batch;
+        batch.swap(buffer);
+        uint64_t target = appendedLsn;
+        uint64_t next = segment + 1;
+        lock.unlock();
+        bool ok = writeAll(batch) && fdatasync(fd) == 0;
+        int nextFd = ok ? open(segmentPath(next).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) : -1;
+        lock.lock();
+
+        flushing = false;
+        if (nextFd < 0) failed = true;
+        else {
+            close(fd);
+            fd = nextFd;
+            segment = next;
+            flushedLsn = target;
+        }
+        flushedCv.notify_all();
+        if (failed) throw std::runtime_error("WAL rotation failed");
+        return next;
+    }
+
+    // Deletes segments made redundant by a checkpoint.
+    void dropSegmentsBefore(uint64_t seq) {
+        for (uint64_t s : listSegments())
+            if (s < seq) unlink(segmentPath(s).c_str());
+    }
+
+    uint64_t appended() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return appendedLsn;
+    }
+
+    // Buffers a record and returns its log sequence number (the log offset
+    // just past it), to be passed to commit().
+    uint64_t append(std::string_view record) {
+        std::lock_guard<std::mutex> lock(mtx);
+        ByteWriter w(buffer);
+        w.u32(static_cast<uint32_t>(record.size()));
+        w.u32(crc32(record));
+        buffer.append(record.data(), record.size());
+        appendedLsn += 8 + record.size();
+        return appendedLsn;
+    }
+
+    void commit(uint64_t lsn) {
+        switch (options.durability) {
+            case Durability::Sync: flushTo(lsn, true); break;
+            case Durability::Os: flushTo(lsn, false); break;
+            case Durability::Batch: {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (failed) throw std::runtime_error("WAL write failed");
+                break;
+            }
+        }
+    }
+
+private:
+    std::string segmentPath(uint64_t seq) const {
+        return options.dir + "/wal." + std::to_string(seq) + ".log";
+    }
+
+    std::vector<uint64_t> listSegments() const {
+        std::vector<uint64_t> found;
+        if (DIR* d = opendir(options.dir.c_str())) {
+            while (dirent* e = readdir(d)) {
+                unsigned long long seq;
+                char tail[8];
+                if (sscanf(e->d_name, "wal.%llu.%7s", &seq, tail) == 2 && std::string(tail) == "log")
+                    found.push_back(seq);
+            }
+            closedir(d);
+        }
+        std::sort(found.begin(), found.end());
+        return found;
+    }
+
+    off_t fileSize(uint64_t seq) const {
+        struct stat st{};
+        return stat(segmentPath(seq).c_str(), &st) == 0 ? st.st_size : -1;
+    }
+
+    // Returns the length of the intact prefix of the segment.
+    static uint64_t replaySegment(int segFd, const std::function<void(std::string_view)>& apply) {
+        std::string pending;
+        uint64_t good = 0;
+        char buffer[1 << 16];
+        bool corrupt = false;
+        while (!corrupt) {
+            ssize_t got = read(segFd, buffer, sizeof(buffer));
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) break;
+            pending.append(buffer, got);
+
+            size_t pos = 0;
+            while (pending.size() - pos >= 8) {
+                ByteReader header(std::string_view(pending).substr(pos, 8));
+                uint32_t length = header.u32(), crc = header.u32();
+                if (pending.size() - pos - 8 < length) break;
+                std::string_view record(pending.data() + pos + 8, length);
+                if (crc32(record) != crc) {
+                    corrupt = true;
+                    break;
+                }
+                apply(record);
+                pos += 8 + length;
+                good += 8 + length;
+            }
+            pending.erase(0, pos);
+        }
+        return good;
+    }
+
+    void flushTo(uint64_t lsn, bool sync) {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (flushedLsn < lsn) {
+            if (failed) throw std::runtime_error("WAL write failed");
+            if (flushing) {
+                flushedCv.wait(lock);
+                continue;
+            }
+
+            flushing = true;
+            std::string batch;
+            batch.swap(buffer);
+            uint64_t target = appendedLsn;
+            lock.unlock();
+            bool ok = writeAll(batch) && (!sync || fdatasync(fd) == 0);
+            lock.lock();
+
+            flushing = false;
+            if (ok) flushedLsn = target;
+            else failed = true;
+            flushedCv.notify_all();
+        }
+    }
+
+    bool writeAll(const std::string& data) {
+        size_t done = 0;
+        while (done < data.size()) {
+            ssize_t n = write(fd, data.data() + done, data.size() - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            done += n;
+        }
+        return true;
+    }
+
+    void runFlusher() {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (!stopping) {
+            timerCv.wait_for(lock, options.batchInterval);
+            uint64_t target = appendedLsn;
+            lock.unlock();
+            try {
+                flushTo(target, true);
+            } catch (std::exception&) {
+                // Surfaced to writers through the failed flag.
+            }
+            lock.lock();
+        }
+    }
+
+    Options options;
+    int fd = -1;
+    uint64_t segment = 0;
+
+    std::mutex mtx;
+    std::condition_variable flushedCv;
+    std::condition_variable timerCv;
+    std::string buffer;          // framed records not yet written
+    uint64_t appendedLsn = 0;
+    uint64_t flushedLsn = 0;
+    bool flushing = false;
+    bool failed = false;
+    bool stopping = false;
+    std::thread flusher;
+};